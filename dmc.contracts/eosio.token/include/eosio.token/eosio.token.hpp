@@ -10,15 +10,17 @@
 #include <eosiolib/crypto.h>
 
 #include <string>
+#include <map>
 #include <cmath>
 
+#include <eosio.token/uniswap_math.hpp>
+
 namespace eosio {
 
 using std::string;
 
 static const account_name eos_account = N(eosio);
 constexpr double static_weights = 10000.0;
-constexpr double uniswap_fee = 0.003;
 constexpr uint64_t uint64_max = ~uint64_t(0);
 constexpr uint64_t minimum_token_precision = 0;
 constexpr double miner_scale = 0.8;
@@ -36,6 +38,14 @@ constexpr uint64_t default_dmc_challenge_interval = 24 * 60 * 60;
 constexpr uint64_t default_bill_dmc_claims_interval = 7 * 24 * 3600;
 constexpr uint64_t price_fluncuation_interval = 7 * 24 * 3600;
 constexpr uint64_t seconds_three_days = 3 * 24 * 3600;
+constexpr uint64_t default_unbond_granularity = 3600;
+constexpr uint64_t default_sample_interval = 24 * 60 * 60;
+constexpr uint64_t default_sample_count = 100;
+constexpr uint64_t default_sample_per_call = 10;
+constexpr uint64_t default_request_key_expiration = 7 * 24 * 3600;
+constexpr uint64_t liquidation_migration_limit = 50;
+constexpr uint64_t lock_migration_limit = 50;
+constexpr uint64_t lock_walk_limit = 50;
 
 // 2
 constexpr uint64_t default_benchmark_stake_rate = 200;
@@ -123,6 +133,18 @@ public:
         extended_asset quantity;
     };
 
+    struct exchange_args {
+        account_name owner;
+        extended_asset quantity;
+        extended_asset min_out;
+    };
+
+    struct sample_proof {
+        uint64_t order_id;
+        std::vector<char> data;
+        std::vector<checksum256> cut_merkle;
+    };
+
 public:
     /*! @brief ClassicToken 创建函数
      @param issuer 通证发行账号
@@ -198,6 +220,24 @@ public:
      */
     void exclose(account_name owner, extended_symbol symbol);
 
+    /*! @brief SmartToken 批量回收余额为0的记录
+     * 每次最多扫描 limit 条记录，owner 名下所有通证中余额为0的记录都会被删除，RAM 退还给该记录原来的付费账户
+     * 不区分通证与付费账户：合约无法读取记录的付费账户，由他人付费创建的记录同样会被删除，之后再入账时重新付费
+     * 只清理单个通证请使用 exclose
+
+     @param owner 待清理的账号，需要 owner 或合约账号授权
+     @param limit 本次最多扫描的记录数
+     */
+    void closezero(account_name owner, uint32_t limit);
+
+    /*! @brief 设置是否接收转账通知
+     * 未部署合约的交易所、出款账号可关闭通知，转账时不再 require_recipient
+
+     @param owner 设置账号
+     @param notify 是否接收通知
+     */
+    void setnotify(account_name owner, bool notify);
+
 public:
     /*! @brief SmartToken 兑换函数
      @param owner 兑换账号
@@ -207,6 +247,21 @@ public:
      */
     void exchange(account_name owner, extended_asset quantity, extended_asset to, double price, account_name id, string memo);
 
+    /*! @brief SmartToken 多跳兑换函数
+     * 按 path 依次经过多个兑换池，中间通证不进入账户余额
+     @param owner 兑换账号
+     @param quantity 兑换通证数量
+     @param path 依次兑换的通证类型，最后一个为目标通证
+     @param min_out 最少获得的目标通证数量
+     */
+    void exchangepath(account_name owner, extended_asset quantity, std::vector<extended_symbol> path, extended_asset min_out);
+
+    /*! @brief SmartToken 批量兑换函数
+     * 同一兑换池的订单双向抵消后按统一价格清算，每个兑换池只成交一次净额
+     @param orders 兑换订单，min_out 为最少获得的目标通证数量
+     */
+    void exchangebatch(std::vector<exchange_args> orders);
+
     /*! @brief SmartToken 删除函数
      * 删除通证满足满足如下条件并回收RAM。
      * 1. 通证发行者
@@ -245,6 +300,32 @@ public:
      */
     void exlock(account_name from, extended_asset quantity, time_point_sec expiration, string memo);
 
+    /*! @brief LockToken 线性释放锁仓函数
+     * 一笔锁仓只占用一条记录，在 cliff_at 之前不可解锁，之后按 start_at 到 end_at 线性释放
+     @param from 发送账号
+     @param to 接收账号
+     @param quantity 锁仓通证数量
+     @param start_at 释放开始时间
+     @param cliff_at 最早可解锁时间
+     @param end_at 释放结束时间
+     @param memo 备注
+     */
+    void exvest(account_name from, account_name to, extended_asset quantity, time_point_sec start_at, time_point_sec cliff_at, time_point_sec end_at, string memo);
+
+    /*! @brief LockToken 领取已线性释放的通证
+     @param owner 领取账号
+     @param primary 锁仓记录 id
+     @param memo 备注
+     */
+    void exunvest(account_name owner, uint64_t primary, string memo);
+
+    /*! @brief LockToken 迁移旧锁仓记录
+     * 将 lockaccounts 中的记录迁移到 lockbalances，每次最多迁移 limit 条，新记录的 RAM 由 owner 支付
+     @param owner 迁移账号
+     @param limit 本次最多迁移的记录数
+     */
+    void lockmig(account_name owner, uint32_t limit);
+
 public:
     /*! @brief uniswap中充值
      @param owner 加仓账户
@@ -253,7 +334,17 @@ public:
     */
     void addreserves(account_name owner, extended_asset token_x, extended_asset token_y);
 
+    /*! @brief uniswap中单边充值
+     * 先将部分通证兑换为另一侧通证，再按池中比例加仓；RSI/DMC 兑换池与 addreserves 一样只允许 datamall 加仓
+     @param owner 加仓账户
+     @param quantity 加仓的通证数
+     @param pair 兑换池中另一侧的通证类型
+     @param min_shares 最少获得的 LP 通证数量
+    */
+    void addreservez(account_name owner, extended_asset quantity, extended_symbol pair, int64_t min_shares);
+
     /*! @brief uniswap中提取
+     * 按比例销毁 owner 持有的 LP 通证并取回两侧通证
      @param owner 提取账户
      @param x  提取 x 的通证类型
      @param y  提取 y 的通证类型
@@ -261,13 +352,36 @@ public:
     */
     void outreserves(account_name owner, extended_symbol x, extended_symbol y, double rate);
 
+    /*! @brief uniswap 迁移旧兑换池记录
+     * 将 swapmarket 中的记录迁移到 swappairs，每次最多迁移 limit 条
+     @param limit 本次最多迁移的记录数
+    */
+    void swapmig(uint32_t limit);
+
+    /*! @brief uniswap 转换旧份额
+     * 将 swappool 中的份额按比例转换为 LP 通证，每次最多转换 limit 条
+     @param x  兑换池 x 的通证类型
+     @param y  兑换池 y 的通证类型
+     @param limit 本次最多转换的记录数
+    */
+    void lpmig(extended_symbol x, extended_symbol y, uint32_t limit);
+
 public:
     /*! @brief 质押PST获得积分
      @param owner 质押账户
      @param asset 质押数量
+     @param price 单价
+     @param request_key 客户端生成的幂等键，重复提交会失败，为 0 时不登记
      @param memo 备注
      */
-    void bill(account_name owner, extended_asset asset, double price, string memo);
+    void bill(account_name owner, extended_asset asset, double price, uint64_t request_key, string memo);
+
+    /*! @brief 删除幂等键
+     * 未过期的幂等键只能由 owner 删除，超过 reqkeyexp 后任何账户都可清理，RAM 退还 owner
+     @param owner 登记账户
+     @param key 幂等键
+    */
+    void delreqkey(account_name owner, uint64_t key);
 
     /*! @brief 取消质押PST
      @param owner 取消质押账户
@@ -282,6 +396,28 @@ public:
     */
     void getincentive(account_name owner, uint64_t bill_id);
 
+    /*! @brief 领取全部挂单的激励
+     * 合并结算 owner 所有挂单累计的激励，一次发放
+     @param owner 领取激励账户
+     @param start_id 从 bill_id 不小于 start_id 的挂单开始，用于分批领取
+     @param limit 本次最多扫描的挂单数，包括无需结算的挂单
+    */
+    void claimallinc(account_name owner, uint64_t start_id, uint32_t limit);
+
+    /*! @brief 清理到期挂单
+     * 由系统账户调用，按到期时间顺序结算到期挂单的最后一笔激励，退还未成交的 PST 并删除挂单
+     * 只清理 owner 已有 PST 与 RSI 余额记录的挂单，不为 owner 新建记录；其余挂单留给 owner 自行 unbill
+     @param limit 本次最多扫描的到期挂单数
+    */
+    void expirebills(uint32_t limit);
+
+    /*! @brief 迁移旧挂单记录
+     * 将 stakerec 中的记录迁移到 bills，每次最多迁移 limit 条
+     @param owner 迁移账号
+     @param limit 本次最多迁移的记录数
+    */
+    void billmig(account_name owner, uint32_t limit);
+
     /*! @brief 设置 DMC 释放
      @param stage 释放阶段，目前1-11
      @param user_rate 释放时用户占比
@@ -293,6 +429,8 @@ public:
     void setabostats(uint64_t stage, double user_rate, double foundation_rate, extended_asset total_release, time_point_sec start_at, time_point_sec end_at);
 
     /** @brief 释放 DMC
+     * 累计所有已开始阶段可释放的份额，直接记入基金会与 abo_account，并以 allocrec 记录入账及原 issue 的备注
+     * 释放数量只由时间决定且每个阶段每天最多释放一次，任何账户（如 keeper）都可以调用，新建的余额记录由合约支付
      @param memo 附言
      */
     void allocation(string memo);
@@ -303,9 +441,10 @@ public:
      @param bill_id 挂单 id
      @param asset 交易数量
      @param reserve 预存数量
+     @param request_key 客户端生成的幂等键，重复提交会失败，为 0 时不登记
      @param memo 附言
      */
-    void order(account_name owner, account_name miner, uint64_t bill_id, extended_asset asset, extended_asset reserve, string memo);
+    void order(account_name owner, account_name miner, uint64_t bill_id, extended_asset asset, extended_asset reserve, uint64_t request_key, string memo);
 
 public:
     /*! @brief 增加准备金
@@ -322,6 +461,11 @@ public:
     */
     void redemption(account_name owner, double rate, account_name miner);
 
+    /*! @brief 领取已到期的赎回准备金
+    @param owner 矿工 / lp
+    */
+    void claimunbond(account_name owner);
+
     /*! @brief 铸造 PST
     @param owner 矿工
     @param asset 铸造的 PST 数量
@@ -334,9 +478,15 @@ public:
     */
     void setmakerrate(account_name owner, double rate);
 
+    /*! @brief 迁移旧矿工记录
+     * 将 dmcmaker 中的记录迁移到 dmcmakers，每次最多迁移 limit 条
+     @param limit 本次最多迁移的记录数
+    */
+    void makermig(uint32_t limit);
+
     /*! @brief 清算
     @param memo 附言
-    由 onblock 方法调用，定期清算
+    由 onblock 方法调用，定期清算；旧矿工记录未迁移完时本次只迁移，不做清算
     */
     void liquidation(string memo);
 
@@ -379,6 +529,31 @@ public:
     */
     void paychallenge(name sender, uint64_t order_id);
 
+    /*! @brief 批量处理超时挑战
+     * 按发起时间顺序结算已超时未应答的挑战，结算方式与 paychallenge 相同
+    @param limit 本次最多处理的挑战数
+    */
+    void sweepchall(uint32_t limit);
+
+    /*! @brief 随机抽查订单
+     * 以交易引用区块的 TaPoS 信息为熵源，随机抽取订单与数据块，每个周期最多抽取 samplecnt 个
+     * 仅系统账户可调用，以免调用方反复挑选 TaPoS 决定抽查结果；单次最多尝试 samplecall 次
+    @param limit 本次最多尝试抽取的次数
+    */
+    void samplechall(uint32_t limit);
+
+    /*! @brief 矿工批量响应抽查
+    @param sender 矿工账户名
+    @param proofs 抽查数据块及默克尔剪枝树信息
+    */
+    void anssamples(name sender, std::vector<sample_proof> proofs);
+
+    /*! @brief 批量处理超时抽查
+     * 超时未响应的抽查按挑战超时结算
+    @param limit 本次最多处理的抽查数
+    */
+    void sweepsample(uint32_t limit);
+
     /*! @brief 设置dmc配置项
     @param payer 配置的键
     @param order_id 配置的值
@@ -405,6 +580,23 @@ public:
     */
     void subordasset(name sender, uint64_t order_id, extended_asset quantity);
 
+    /*! @brief 设置订单自动续费
+     * 结算周期到期而预存额不足一个周期费用时，从用户余额中补足，累计补足金额不超过 cap
+    @param sender 账户名
+    @param order_id 订单id
+    @param cap 自动续费额度，为 0 时关闭
+    */
+    void setautopay(name sender, uint64_t order_id, extended_asset cap);
+
+    /*! @brief 调整订单容量
+     * 按挂单价格调整订单的 PST 与每周期费用；交付中的订单按已过时间结算当前周期，并从调整时起开始新周期
+     * 挂单已不存在时只允许缩容，价格按原订单比例折算
+    @param sender 账户名
+    @param order_id 订单id
+    @param delta_pst 增加为正，减少为负
+    */
+    void resizeorder(name sender, uint64_t order_id, extended_asset delta_pst);
+
     /*! @brief 更新订单状态
     @param payer 账户名
     @param order_id 订单id
@@ -465,13 +657,21 @@ public:
     void burnbatch(name from, std::vector<nft_batch_args> batch_args);
 
 private:
-    void uniswaporder(account_name owner, extended_asset quantity, extended_asset to, double price, account_name id, account_name rampay);
+    void uniswaporder(account_name owner, extended_asset quantity, extended_asset to, account_name id, account_name rampay);
+    void uniswaptrade(account_name owner, extended_asset& from, extended_asset& to, account_name rampay);
+    void uniswapbatch(const std::vector<exchange_args>& orders);
+    extended_asset uniswapdeposit(account_name owner, extended_asset x, extended_asset y);
+    extended_symbol alloc_lp_symbol();
+    void create_lp_token(extended_symbol lp_sym, account_name payer);
+    int64_t get_lp_supply(extended_symbol lp_sym);
+    bool is_lp_symbol(extended_symbol sym);
     double get_real_asset(extended_asset quantity);
+    uint64_t get_uniswap_price(extended_asset market_from, extended_asset market_to);
 
     template <typename T, T (*wipe_function)(T)>
     extended_asset get_asset_by_amount(T amount, extended_symbol symbol);
 
-    void uniswapdeal(account_name owner, extended_asset& market_from, extended_asset& market_to, extended_asset from, extended_asset to_sym, uint64_t primary, double price, account_name rampay);
+    void uniswapdeal(account_name owner, extended_asset& market_from, extended_asset& market_to, extended_asset& from, extended_asset& to);
 
 public:
     void receipt(extended_asset in, extended_asset out, extended_asset fee);
@@ -493,6 +693,7 @@ public:
     void makercharec(account_name sender, account_name miner, extended_asset changed, MakerReceiptType type);
     void ordercharec(uint64_t order_id, extended_asset storage, extended_asset lock, extended_asset settlement, extended_asset challenge, time_point_sec exec_date, OrderReceiptType type);
     void assetcharec(account_name owner, extended_asset changed, uint8_t type, uint64_t id);
+    void allocrec(account_name owner, extended_asset quantity, string memo);
 
 public:
     void nftsymrec(uint64_t symbol_id, extended_symbol nft_symbol, std::string symbol_uri, nft_type type);
@@ -599,7 +800,8 @@ private:
         indexed_by<N(byextendedasset), const_mem_fun<account, uint128_t, &account::get_key>>>
         accounts;
 
-    struct lock_account : public account {
+    // 旧锁仓表，仅用于迁移到 lockbalances
+    struct legacy_lock_account : public account {
         time_point_sec lock_timestamp;
 
         static key256 key(extended_symbol symbol, time_point_sec lock_timestamp)
@@ -608,12 +810,54 @@ private:
         }
         key256 get_key() const { return key(balance.get_extended_symbol(), lock_timestamp); }
 
-        EOSLIB_SERIALIZE(lock_account, (primary)(balance)(lock_timestamp))
+        EOSLIB_SERIALIZE(legacy_lock_account, (primary)(balance)(lock_timestamp))
+    };
+
+    typedef eosio::multi_index<N(lockaccounts), legacy_lock_account,
+        indexed_by<N(byextendedasset), const_mem_fun<legacy_lock_account, key256, &legacy_lock_account::get_key>>>
+        legacy_lock_accounts;
+
+    // 每个 (owner, extended_symbol) 一条锁仓分组，id 作为 lockbalances 的 scope
+    struct lock_bucket {
+        uint64_t id;
+        extended_symbol symbol;
+
+        uint64_t primary_key() const { return id; }
+        uint128_t get_key() const { return account::key(symbol); }
+
+        EOSLIB_SERIALIZE(lock_bucket, (id)(symbol))
     };
 
-    typedef eosio::multi_index<N(lockaccounts), lock_account,
-        indexed_by<N(byextendedasset), const_mem_fun<lock_account, key256, &lock_account::get_key>>>
-        lock_accounts;
+    typedef eosio::multi_index<N(lockbuckets), lock_bucket,
+        indexed_by<N(bysymbol), const_mem_fun<lock_bucket, uint128_t, &lock_bucket::get_key>>>
+        lock_buckets;
+
+    // 同一分组内以 lock_timestamp 为主键，按到期时间排列
+    // exlock / exlocktrans 仍按到期时间各占一条记录，因为 exunlock / exlocktrans 按到期时间指定记录；
+    // 长期分批释放应使用 exvest，赎回已改用 unbonding 队列
+    struct lock_balance {
+        extended_asset balance;
+        time_point_sec lock_timestamp;
+
+        uint64_t primary_key() const { return lock_timestamp.sec_since_epoch(); }
+
+        EOSLIB_SERIALIZE(lock_balance, (balance)(lock_timestamp))
+    };
+
+    typedef eosio::multi_index<N(lockbalances), lock_balance> lock_balances;
+
+    struct vesting_schedule {
+        uint64_t primary;
+        extended_asset total;
+        extended_asset released;
+        time_point_sec start_at;
+        time_point_sec cliff_at;
+        time_point_sec end_at;
+
+        uint64_t primary_key() const { return primary; }
+        EOSLIB_SERIALIZE(vesting_schedule, (primary)(total)(released)(start_at)(cliff_at)(end_at))
+    };
+    typedef eosio::multi_index<N(vestings), vesting_schedule> vestings;
 
     struct currency_stats {
         account_name issuer; // 发行者
@@ -630,7 +874,15 @@ private:
 
     typedef eosio::multi_index<N(stats), currency_stats> stats;
 
-    struct uniswap_market {
+    struct notify_optout {
+        account_name owner;
+
+        uint64_t primary_key() const { return owner; }
+        EOSLIB_SERIALIZE(notify_optout, (owner))
+    };
+    typedef eosio::multi_index<N(nonotify), notify_optout> notify_optouts;
+
+    struct legacy_uniswap_market {
         uint64_t primary;
         extended_asset tokenx;
         extended_asset tokeny;
@@ -647,11 +899,54 @@ private:
             return key256::make_from_word_sequence<uint64_t>(symbolx.name(), symbolx.contract, symboly.name(), symboly.contract);
         }
         key256 get_key() const { return key(tokenx.get_extended_symbol(), tokeny.get_extended_symbol()); }
-        EOSLIB_SERIALIZE(uniswap_market, (primary)(tokenx)(tokeny)(total_weights))
+        EOSLIB_SERIALIZE(legacy_uniswap_market, (primary)(tokenx)(tokeny)(total_weights))
     };
-    typedef eosio::multi_index<N(swapmarket), uniswap_market,
-        indexed_by<N(bysymbol), const_mem_fun<uniswap_market, key256, &uniswap_market::get_key>>>
-        swap_market;
+    typedef eosio::multi_index<N(swapmarket), legacy_uniswap_market,
+        indexed_by<N(bysymbol), const_mem_fun<legacy_uniswap_market, key256, &legacy_uniswap_market::get_key>>>
+        legacy_swap_market;
+
+    // 以交易对 id 为主键的兑换池，primary 沿用为 swappool 的 scope
+    // 份额为 lp_symbol 的 LP 通证，total_weights / legacy_shares 为 swappool 中尚未转换的旧份额
+    // 两次快照的累计价格之差除以时间差即为该区间的 TWAP（2^32 定点）
+    struct uniswap_market {
+        uint64_t pair_id;
+        uint64_t primary;
+        extended_asset tokenx;
+        extended_asset tokeny;
+        double total_weights;
+        int64_t legacy_shares;
+        symbol_type lp_symbol; // 创建兑换池时由 lpsymbol 序列分配
+        uint128_t pricex_cumulative; // tokeny / tokenx
+        uint128_t pricey_cumulative; // tokenx / tokeny
+        time_point_sec updated_at;
+
+        uint64_t primary_key() const { return pair_id; }
+        // 有序交易对的 sha256 取前 64 位，使用前需校验 match 以排除碰撞
+        static uint64_t pair_key(extended_symbol symbolx, extended_symbol symboly)
+        {
+            if (symbolx < symboly) {
+                auto swap = symbolx;
+                symbolx = symboly;
+                symboly = swap;
+            }
+            uint64_t words[4] = { symbolx.name(), symbolx.contract, symboly.name(), symboly.contract };
+            checksum256 hash;
+            sha256((const char*)words, sizeof(words), &hash);
+            uint64_t id = 0;
+            for (int i = 0; i < 8; i++)
+                id = (id << 8) | hash.hash[i];
+            return id;
+        }
+        bool match(extended_symbol symbolx, extended_symbol symboly) const
+        {
+            auto same = [](extended_symbol a, extended_symbol b) { return a.name() == b.name() && a.contract == b.contract; };
+            auto x = tokenx.get_extended_symbol();
+            auto y = tokeny.get_extended_symbol();
+            return (same(x, symbolx) && same(y, symboly)) || (same(x, symboly) && same(y, symbolx));
+        }
+        EOSLIB_SERIALIZE(uniswap_market, (pair_id)(primary)(tokenx)(tokeny)(total_weights)(legacy_shares)(lp_symbol)(pricex_cumulative)(pricey_cumulative)(updated_at))
+    };
+    typedef eosio::multi_index<N(swappairs), uniswap_market> swap_market;
 
     struct market_pool {
         account_name owner;
@@ -662,7 +957,7 @@ private:
     };
     typedef eosio::multi_index<N(swappool), market_pool> swap_pool;
 
-    struct bill_record {
+    struct legacy_bill_record {
         uint64_t primary;
         uint64_t bill_id;
         account_name owner;
@@ -676,13 +971,42 @@ private:
         uint64_t get_lower() const { return price; }
         uint64_t get_time() const { return uint64_t(updated_at.sec_since_epoch()); };
         uint64_t get_stake_id() const { return bill_id; }
-        EOSLIB_SERIALIZE(bill_record, (primary)(bill_id)(owner)(matched)(unmatched)(price)(created_at)(updated_at))
+        EOSLIB_SERIALIZE(legacy_bill_record, (primary)(bill_id)(owner)(matched)(unmatched)(price)(created_at)(updated_at))
     };
-    typedef eosio::multi_index<N(stakerec), bill_record,
-        indexed_by<N(bylowerprice), const_mem_fun<bill_record, uint64_t, &bill_record::get_lower>>,
-        indexed_by<N(bytime), const_mem_fun<bill_record, uint64_t, &bill_record::get_time>>,
-        indexed_by<N(byid), const_mem_fun<bill_record, uint64_t, &bill_record::get_stake_id>>>
-        bill_stats;
+    typedef eosio::multi_index<N(stakerec), legacy_bill_record,
+        indexed_by<N(bylowerprice), const_mem_fun<legacy_bill_record, uint64_t, &legacy_bill_record::get_lower>>,
+        indexed_by<N(bytime), const_mem_fun<legacy_bill_record, uint64_t, &legacy_bill_record::get_time>>,
+        indexed_by<N(byid), const_mem_fun<legacy_bill_record, uint64_t, &legacy_bill_record::get_stake_id>>>
+        legacy_bill_stats;
+
+    // matched / unmatched 为 PST 数量
+    struct bill_record {
+        uint64_t bill_id;
+        account_name owner;
+        int64_t matched;
+        int64_t unmatched;
+        uint64_t price;
+        time_point_sec created_at;
+        time_point_sec updated_at;
+
+        uint64_t primary_key() const { return bill_id; }
+        EOSLIB_SERIALIZE(bill_record, (bill_id)(owner)(matched)(unmatched)(price)(created_at)(updated_at))
+    };
+    typedef eosio::multi_index<N(bills), bill_record> bill_stats;
+
+    // 挂单到期索引，scope 为 _self，到期时间为 created_at + billinter
+    struct bill_expiry {
+        uint64_t bill_id;
+        account_name owner;
+        time_point_sec expire_at;
+
+        uint64_t primary_key() const { return bill_id; }
+        uint64_t get_expire() const { return uint64_t(expire_at.sec_since_epoch()); }
+        EOSLIB_SERIALIZE(bill_expiry, (bill_id)(owner)(expire_at))
+    };
+    typedef eosio::multi_index<N(billexpiry), bill_expiry,
+        indexed_by<N(byexpiry), const_mem_fun<bill_expiry, uint64_t, &bill_expiry::get_expire>>>
+        bill_expiries;
 
     struct pst_stats {
         account_name owner;
@@ -709,23 +1033,26 @@ private:
     };
     typedef eosio::multi_index<N(abostats), abo_stats> abostats;
 
-    struct stake_id_args {
-        account_name owner;
-        extended_asset quantity;
-        uint64_t price;
-        time now;
-        string memo;
+    // 挂单、订单等的自增 id，key 为序列名
+    struct id_sequence {
+        account_name key;
+        uint64_t next_id;
+
+        uint64_t primary_key() const { return key; }
+        EOSLIB_SERIALIZE(id_sequence, (key)(next_id))
     };
+    typedef eosio::multi_index<N(idsequence), id_sequence> id_sequences;
 
-    struct order_id_args {
-        account_name owner;
-        account_name miner;
-        uint64_t bill_id;
-        extended_asset asset;
-        extended_asset reserve;
-        string memo;
-        time_point_sec now;
+    // 客户端幂等键，scope 为 owner，id 为 bill / order 分配的 id
+    struct request_key {
+        uint64_t key;
+        uint64_t id;
+        time_point_sec created_at;
+
+        uint64_t primary_key() const { return key; }
+        EOSLIB_SERIALIZE(request_key, (key)(id)(created_at))
     };
+    typedef eosio::multi_index<N(reqkeys), request_key> request_keys;
 
     struct dmc_config {
         account_name key;
@@ -784,6 +1111,71 @@ private:
     };
     typedef eosio::multi_index<N(dmchallenge), dmc_challenge> dmc_challenges;
 
+    // 订单自动续费额度，remaining 为剩余可从用户余额扣除的 dmc
+    struct order_autopay {
+        uint64_t order_id;
+        account_name user;
+        extended_asset remaining;
+
+        uint64_t primary_key() const { return order_id; }
+        EOSLIB_SERIALIZE(order_autopay, (order_id)(user)(remaining))
+    };
+    typedef eosio::multi_index<N(autopay), order_autopay> order_autopays;
+
+    // 等待矿工应答的挑战，按发起时间排序，超时时间为 challenge_date + challinter
+    struct challenge_request {
+        uint64_t order_id;
+        time_point_sec challenge_date;
+
+        uint64_t primary_key() const { return order_id; }
+        uint64_t get_date() const { return uint64_t(challenge_date.sec_since_epoch()); }
+        EOSLIB_SERIALIZE(challenge_request, (order_id)(challenge_date))
+    };
+    typedef eosio::multi_index<N(challqueue), challenge_request,
+        indexed_by<N(bydate), const_mem_fun<challenge_request, uint64_t, &challenge_request::get_date>>>
+        challenge_requests;
+
+    // 合约抽查的数据块，超时时间为 created_at + challinter
+    struct challenge_sample {
+        uint64_t order_id;
+        account_name miner;
+        uint64_t data_id;
+        time_point_sec created_at;
+
+        uint64_t primary_key() const { return order_id; }
+        uint64_t get_miner() const { return miner; }
+        uint64_t get_date() const { return uint64_t(created_at.sec_since_epoch()); }
+        EOSLIB_SERIALIZE(challenge_sample, (order_id)(miner)(data_id)(created_at))
+    };
+    typedef eosio::multi_index<N(challsample), challenge_sample,
+        indexed_by<N(miner), const_mem_fun<challenge_sample, uint64_t, &challenge_sample::get_miner>>,
+        indexed_by<N(bydate), const_mem_fun<challenge_sample, uint64_t, &challenge_sample::get_date>>>
+        challenge_samples;
+
+    // 可抽查订单（Deliver / PreCont / PreEnd）的稠密编号，position 为 0 到总数减 1，删除时由末尾记录补位
+    struct sample_index {
+        uint64_t position;
+        uint64_t order_id;
+
+        uint64_t primary_key() const { return position; }
+        uint64_t get_order_id() const { return order_id; }
+        EOSLIB_SERIALIZE(sample_index, (position)(order_id))
+    };
+    typedef eosio::multi_index<N(sampleindex), sample_index,
+        indexed_by<N(orderid), const_mem_fun<sample_index, uint64_t, &sample_index::get_order_id>>>
+        sample_indexes;
+
+    // 抽查周期进度，seed 为上一次抽查使用的随机种子
+    struct sample_state {
+        time_point_sec period_start;
+        uint64_t sampled;
+        uint64_t seed;
+
+        uint64_t primary_key() const { return 1; }
+        EOSLIB_SERIALIZE(sample_state, (period_start)(sampled)(seed))
+    };
+    typedef eosio::multi_index<N(samplestate), sample_state> sample_states;
+
     struct limited_partner {
         account_name owner;
         extended_asset staked;
@@ -791,18 +1183,34 @@ private:
     };
 
     // pst 铸造表
+    struct legacy_dmc_maker {
+        account_name miner;
+        double current_rate; // r
+        double miner_rate;
+        double total_weight;
+        extended_asset total_staked;
+
+        uint64_t primary_key() const { return miner; }
+        double by_rate() const { return current_rate; }
+        EOSLIB_SERIALIZE(legacy_dmc_maker, (miner)(current_rate)(miner_rate)(total_weight)(total_staked))
+    };
+    typedef eosio::multi_index<N(dmcmaker), legacy_dmc_maker,
+        indexed_by<N(byrate), const_mem_fun<legacy_dmc_maker, double, &legacy_dmc_maker::by_rate>>>
+        legacy_dmc_makers;
+
     struct dmc_maker {
         account_name miner;
         double current_rate; // r
         double miner_rate;
         double total_weight;
         extended_asset total_staked;
+        int64_t total_pst; // 与 pststats 一致，和 current_rate 同时更新
 
         uint64_t primary_key() const { return miner; }
         double by_rate() const { return current_rate; }
-        EOSLIB_SERIALIZE(dmc_maker, (miner)(current_rate)(miner_rate)(total_weight)(total_staked))
+        EOSLIB_SERIALIZE(dmc_maker, (miner)(current_rate)(miner_rate)(total_weight)(total_staked)(total_pst))
     };
-    typedef eosio::multi_index<N(dmcmaker), dmc_maker,
+    typedef eosio::multi_index<N(dmcmakers), dmc_maker,
         indexed_by<N(byrate), const_mem_fun<dmc_maker, double, &dmc_maker::by_rate>>>
         dmc_makers;
 
@@ -814,6 +1222,16 @@ private:
         EOSLIB_SERIALIZE(maker_pool, (owner)(weight))
     };
     typedef eosio::multi_index<N(makerpool), maker_pool> dmc_maker_pool;
+
+    // 赎回排队表，到期时间按 unbondgran 向上取整合并
+    struct unbond_entry {
+        time_point_sec release_at;
+        extended_asset quantity;
+
+        uint64_t primary_key() const { return uint64_t(release_at.sec_since_epoch()); }
+        EOSLIB_SERIALIZE(unbond_entry, (release_at)(quantity))
+    };
+    typedef eosio::multi_index<N(unbonding), unbond_entry> unbond_queue;
     struct price_history {
         uint64_t primary;
         uint64_t bill_id;
@@ -848,6 +1266,39 @@ private:
     };
     typedef eosio::multi_index<N(ordermiginfo), order_migration> order_migration_table;
 
+    // 挂单、订单、挑战的聚合统计，minerstats 按矿工记录，dmcstats 中 miner 为 0 的记录为全局汇总
+    struct dmc_aggregate {
+        account_name miner = 0;
+        int64_t bill_pst = 0; // 挂单中未成交的 PST
+        int64_t matched_pst = 0; // 挂单中已成交的 PST
+        int64_t active_orders = 0; // 未结束的订单数
+        int64_t pledged_dmc = 0; // 订单中 user_pledge、lock_pledge、settlement_pledge 之和
+        int64_t open_challenges = 0; // 等待应答的挑战数
+        int64_t total_challenges = 0; // 累计发起的挑战数
+
+        uint64_t primary_key() const { return miner; }
+        EOSLIB_SERIALIZE(dmc_aggregate, (miner)(bill_pst)(matched_pst)(active_orders)(pledged_dmc)(open_challenges)(total_challenges))
+    };
+    typedef eosio::multi_index<N(minerstats), dmc_aggregate> miner_stats;
+
+    // 全局汇总；statsmig 完成前 incomplete 为 true，此时全局与各矿工的统计都未包含尚未扫描的订单
+    struct dmc_global_aggregate : dmc_aggregate {
+        bool incomplete = true;
+
+        EOSLIB_SERIALIZE_DERIVED(dmc_global_aggregate, dmc_aggregate, (incomplete))
+    };
+    typedef eosio::multi_index<N(dmcstats), dmc_global_aggregate> market_stats;
+
+    // 订单统计的初始化进度，order_id 不大于 current_id 的订单才按增量维护
+    struct stats_migration {
+        uint64_t current_id;
+        bool finished;
+
+        uint64_t primary_key() const { return 1; }
+        EOSLIB_SERIALIZE(stats_migration, (current_id)(finished))
+    };
+    typedef eosio::multi_index<N(statsmiginfo), stats_migration> stats_migration_table;
+
 public:
     void set_order_migration(uint64_t order_id, account_name payer)
     {
@@ -868,6 +1319,13 @@ public:
 public:
     void ordermig(account_name payer, uint32_t limit);
 
+    /*! @brief 初始化订单统计
+     * 按 order_id 顺序将已有订单与挑战计入 minerstats / dmcstats，每次最多处理 limit 条，全部完成后清除 dmcstats 的 incomplete
+    @param payer 账户名
+    @param limit 本次最多处理的订单数
+    */
+    void statsmig(account_name payer, uint32_t limit);
+
 private:
     inline static account_name get_foundation(account_name issuer)
     {
@@ -877,22 +1335,72 @@ private:
     void sub_balance(account_name owner, extended_asset value);
     void add_balance(account_name owner, extended_asset value, account_name ram_payer);
 
+    void notify_recipient(account_name owner);
+    // 单个 action 内的 nonotify 查询缓存
+    std::map<account_name, bool> notify_cache;
+    // 单个 action 内的 closezero 配置缓存，-1 表示尚未读取
+    // 开启后对所有通证生效，sub_balance 扣减到0时直接删除记录，不区分付费账户
+    int8_t closezero_cache = -1;
+    bool is_closezero_enabled();
+
     void lock_sub_balance(account_name owner, extended_asset value, time_point_sec lock_timestamp);
     void lock_sub_balance(account_name foundation, extended_asset quantity, bool recur = false);
     void lock_add_balance(account_name owner, extended_asset value, time_point_sec lock_timestamp, account_name ram_payer);
+    extended_asset get_vested(const vesting_schedule& schedule, time_point_sec now_time);
+    uint64_t find_lock_bucket(account_name owner, extended_symbol sym);
+    void erase_empty_lock_bucket(account_name owner, uint64_t bucket_id);
+    void migrate_lock_account(account_name owner, extended_symbol sym, time_point_sec lock_timestamp, account_name ram_payer);
+    void migrate_lock_symbol(account_name owner, extended_symbol sym, account_name ram_payer);
+    void migrate_lock_accounts(account_name owner, uint64_t limit, account_name ram_payer);
+    void unlock_matured(account_name owner, extended_asset value, account_name ram_payer);
+    extended_asset get_matured_balance(account_name owner, extended_symbol sym);
+    swap_market::const_iterator find_market(swap_market& market, extended_symbol x, extended_symbol y);
+    void convert_lp_weights(swap_market& market, const uniswap_market& m, account_name owner);
+    extended_symbol get_lp_symbol(const uniswap_market& m);
+    void update_cumulative(uniswap_market& m);
 
     extended_asset get_balance(extended_asset quantity, account_name name);
+    bool has_balance_record(account_name owner, extended_symbol sym);
 
 private:
     uint64_t calbonus(account_name owner, uint64_t primary, account_name ram_payer);
+    uint64_t accrue_incentive(const bill_record& bill, uint64_t claims_interval, int64_t unit_amount, int64_t& amount);
+    void migrate_bills(account_name owner, uint64_t limit = uint64_max);
+    void close_bill(account_name owner, uint64_t bill_id, account_name ram_payer);
+    void add_bill_expiry(account_name owner, uint64_t bill_id, time_point_sec created_at);
+    void remove_bill_expiry(account_name owner, uint64_t bill_id);
+    uint64_t next_id(account_name sequence);
+    void add_request_key(account_name owner, uint64_t key, uint64_t id);
     double cal_makerd_pst(extended_asset dmc_asset);
-    double cal_current_rate(extended_asset dmc_asset, account_name owner);
+    double cal_current_rate(extended_asset dmc_asset, int64_t total_pst);
+    void change_maker_pst(account_name miner, int64_t delta);
+    void migrate_maker(account_name miner);
+    void migrate_makers(uint64_t limit = uint64_max);
+    void add_unbonding(account_name owner, extended_asset quantity);
+    extended_asset release_unbonding(account_name owner, int64_t max_amount = asset::max_amount);
 
 private:
     void change_order(dmc_order& order, const dmc_challenge& challenge, time_point_sec current, uint64_t claims_interval, name payer);
     void update_order(dmc_order& order, const dmc_challenge& challenge, name payer);
+    void topup_order_pledge(dmc_order& order);
+    void remove_order_autopay(uint64_t order_id);
     void destory_pst(const dmc_order& info);
     void claim_dmc_reward(const dmc_order& info, dmc_challenge& challenge, account_name payer);
+    void settle_challenge_timeout(uint64_t order_id, account_name payer);
+    void remove_challenge_request(uint64_t order_id);
+    bool is_merkle_proof_valid(const checksum256& merkle_root, uint64_t data_id, const std::vector<char>& data, const std::vector<checksum256>& cut_merkle);
+    checksum256 sample_hash(uint64_t seed, uint64_t index);
+    bool is_sample_eligible(OrderState state);
+    void add_sample_index(uint64_t order_id);
+    void remove_sample_index(uint64_t order_id);
+
+private:
+    void change_dmc_stats(account_name miner, const dmc_aggregate& delta);
+    void change_bill_stats(account_name miner, int64_t unmatched, int64_t matched);
+    bool is_stats_tracked(uint64_t order_id);
+    dmc_aggregate get_order_aggregate(const dmc_order& order);
+    void change_order_stats(const dmc_order& before, const dmc_order& after);
+    void change_challenge_stats(const dmc_order& order, ChallengeState before, ChallengeState after);
 };
 
 asset token::get_supply(symbol_type sym) const
@@ -0,0 +1,206 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ */
+#pragma once
+#include <cstdint>
+
+// 兑换池的纯整数运算，不依赖链上状态，使用前需已定义 uint128_t 与 eosio_assert
+
+// 0.3%
+constexpr uint64_t uniswap_fee_rate = 3;
+constexpr uint64_t uniswap_fee_base = 1000;
+// 与 asset::max_amount 一致
+constexpr int64_t uniswap_max_amount = (int64_t(1) << 62) - 1;
+
+uint64_t integer_sqrt(uint128_t value)
+{
+    if (value == 0)
+        return 0;
+
+    uint64_t high = uint64_t(value >> 64);
+    uint64_t low = uint64_t(value);
+    uint64_t bits = high != 0 ? 128 - __builtin_clzll(high) : 64 - __builtin_clzll(low);
+    // 初值不小于 sqrt(value)，牛顿迭代单调递减
+    uint128_t x = uint128_t(1) << ((bits + 1) / 2);
+    while (true) {
+        uint128_t y = (x + value / x) >> 1;
+        if (y >= x)
+            return uint64_t(x);
+        x = y;
+    }
+}
+
+uint128_t mul_uint128(uint128_t a, uint128_t b)
+{
+    eosio_assert(b == 0 || a <= ~uint128_t(0) / b, "multiplication overflow");
+    return a * b;
+}
+
+// 256 位中间值，储备接近 asset::max_amount 时乘积会超过 128 位
+struct uint256_parts {
+    uint128_t high;
+    uint128_t low;
+};
+
+uint256_parts mul_wide(uint128_t a, uint128_t b)
+{
+    uint128_t mask = ~uint64_t(0);
+    uint128_t a_lo = a & mask, a_hi = a >> 64;
+    uint128_t b_lo = b & mask, b_hi = b >> 64;
+
+    uint128_t lo_lo = a_lo * b_lo;
+    uint128_t hi_lo = a_hi * b_lo;
+    uint128_t lo_hi = a_lo * b_hi;
+    uint128_t hi_hi = a_hi * b_hi;
+
+    uint128_t cross = (lo_lo >> 64) + (hi_lo & mask) + (lo_hi & mask);
+    uint256_parts r;
+    r.low = (cross << 64) | (lo_lo & mask);
+    r.high = hi_hi + (hi_lo >> 64) + (lo_hi >> 64) + (cross >> 64);
+    return r;
+}
+
+bool wide_less(const uint256_parts& a, const uint256_parts& b)
+{
+    return a.high < b.high || (a.high == b.high && a.low < b.low);
+}
+
+// floor(n / d)，商需在 128 位以内
+uint128_t div_wide(const uint256_parts& n, uint128_t d)
+{
+    eosio_assert(d != 0, "division by zero");
+    if (n.high == 0)
+        return n.low / d;
+    eosio_assert(n.high < d, "division overflow");
+
+    uint128_t rem = n.high;
+    uint128_t quotient = 0;
+    for (int i = 127; i >= 0; i--) {
+        bool carry = (rem >> 127) != 0;
+        rem = (rem << 1) | ((n.low >> i) & 1);
+        quotient <<= 1;
+        if (carry || rem >= d) {
+            rem -= d;
+            quotient |= 1;
+        }
+    }
+    return quotient;
+}
+
+// floor(a * b / c)
+uint128_t mul_div(uint128_t a, uint128_t b, uint128_t c)
+{
+    return div_wide(mul_wide(a, b), c);
+}
+
+// floor(sqrt(n))，n 不超过 2^254
+uint128_t integer_sqrt_wide(const uint256_parts& n)
+{
+    if (n.high == 0)
+        return integer_sqrt(n.low);
+    eosio_assert((n.high >> 126) == 0, "sqrt overflow");
+
+    // 取 n 的高 128 位开方作初值：不小于 sqrt(n) 且不超过 2^127，保证每次除法的商在 128 位以内，一两次迭代即可收敛
+    uint64_t bits = n.high >> 64 != 0 ? 128 - __builtin_clzll(uint64_t(n.high >> 64)) : 64 - __builtin_clzll(uint64_t(n.high));
+    uint64_t shift = (bits + 1) & ~uint64_t(1);
+    uint128_t top = (n.high << (128 - shift)) | (n.low >> shift);
+    uint128_t x = (uint128_t(integer_sqrt(top)) + 1) << (shift / 2);
+    while (true) {
+        uint128_t y = (x + div_wide(n, x)) >> 1;
+        if (y >= x)
+            return x;
+        x = y;
+    }
+}
+
+int64_t to_amount(uint128_t value)
+{
+    eosio_assert(value <= uint128_t(uniswap_max_amount), "uniswap amount overflow");
+    return int64_t(value);
+}
+
+// amount_out = in * (1 - fee) * y / (x + in * (1 - fee))
+int64_t uniswap_amount_out(int64_t amount_in, int64_t reserve_in, int64_t reserve_out)
+{
+    eosio_assert(amount_in > 0, "must swap positive amount");
+    eosio_assert(reserve_in > 0 && reserve_out > 0, "insufficient liquidity");
+
+    uint128_t amount_in_with_fee = uint128_t(amount_in) * (uniswap_fee_base - uniswap_fee_rate);
+    uint128_t denominator = uint128_t(reserve_in) * uniswap_fee_base + amount_in_with_fee;
+    return to_amount(mul_div(amount_in_with_fee, reserve_out, denominator));
+}
+
+// 向上取整，保证 k 不减少
+int64_t uniswap_amount_in(int64_t amount_out, int64_t reserve_in, int64_t reserve_out)
+{
+    eosio_assert(amount_out > 0, "must swap positive amount");
+    eosio_assert(reserve_in > 0 && amount_out < reserve_out, "insufficient liquidity");
+
+    uint128_t denominator = uint128_t(reserve_out - amount_out) * (uniswap_fee_base - uniswap_fee_rate);
+    return to_amount(mul_div(uint128_t(reserve_in) * uniswap_fee_base, amount_out, denominator) + 1);
+}
+
+// 单边加仓时需兑换的数量，使兑换后剩余部分与池中比例一致
+// swap = (sqrt(R * (R * (2 - f)^2 + 4 * (1 - f) * in)) - R * (2 - f)) / (2 * (1 - f))
+int64_t uniswap_zap_amount(int64_t amount_in, int64_t reserve_in)
+{
+    eosio_assert(amount_in > 0, "must swap positive amount");
+    eosio_assert(reserve_in > 0, "insufficient liquidity");
+
+    uint128_t two_minus_fee = 2 * uniswap_fee_base - uniswap_fee_rate;
+    uint128_t one_minus_fee = uniswap_fee_base - uniswap_fee_rate;
+    uint128_t inner = uint128_t(reserve_in) * two_minus_fee * two_minus_fee + uint128_t(amount_in) * 4 * uniswap_fee_base * one_minus_fee;
+    uint128_t root = integer_sqrt_wide(mul_wide(reserve_in, inner));
+    uint128_t swap_amount = (root - reserve_in * two_minus_fee) / (2 * one_minus_fee);
+    eosio_assert(swap_amount > 0 && swap_amount < uint128_t(amount_in), "dust attack detected in uniswap");
+    return to_amount(swap_amount);
+}
+
+// 批量订单的统一价格 price = price_num / price_den（每单位 x 兑换的 y），返回净额是否进入兑换池
+// x 净流入时：price = (1 - fee) * (Y + in_y) / (X + (1 - fee) * in_x)，y 净流入时对称
+// 抵消后双方都不足以推动兑换池时，按 in_y / in_x 直接互换，不收手续费
+bool uniswap_batch_price(int64_t in_x, int64_t in_y, int64_t reserve_x, int64_t reserve_y, uint128_t& price_num, uint128_t& price_den)
+{
+    uint128_t fee_keep = uniswap_fee_base - uniswap_fee_rate;
+    if (wide_less(mul_wide(uint128_t(uniswap_fee_base) * in_y, reserve_x), mul_wide(fee_keep * in_x, reserve_y))) {
+        price_num = fee_keep * (uint128_t(reserve_y) + in_y);
+        price_den = uniswap_fee_base * uint128_t(reserve_x) + fee_keep * in_x;
+        return true;
+    }
+    if (wide_less(mul_wide(uint128_t(uniswap_fee_base) * in_x, reserve_y), mul_wide(fee_keep * in_y, reserve_x))) {
+        price_num = uniswap_fee_base * uint128_t(reserve_y) + fee_keep * in_y;
+        price_den = fee_keep * (uint128_t(reserve_x) + in_x);
+        return true;
+    }
+    price_num = in_y;
+    price_den = in_x;
+    return false;
+}
+
+// 按统一价格计算单个订单的输出，向下取整，零头留在兑换池中
+int64_t uniswap_batch_out(int64_t quantity, bool from_x, uint128_t price_num, uint128_t price_den)
+{
+    if (from_x)
+        return to_amount(mul_div(quantity, price_num, price_den));
+    return to_amount(mul_div(quantity, price_den, price_num));
+}
+
+// 加仓按两侧中较小的比例发行 LP 通证，首次加仓按 sqrt(x * y) 发行
+int64_t lp_mint_shares(int64_t amount_x, int64_t amount_y, int64_t reserve_x, int64_t reserve_y, int64_t supply)
+{
+    if (supply == 0)
+        return int64_t(integer_sqrt(uint128_t(amount_x) * amount_y));
+
+    eosio_assert(reserve_x > 0 && reserve_y > 0, "insufficient liquidity");
+    uint128_t shares_x = uint128_t(amount_x) * supply / reserve_x;
+    uint128_t shares_y = uint128_t(amount_y) * supply / reserve_y;
+    return int64_t(shares_x < shares_y ? shares_x : shares_y);
+}
+
+// 赎回 shares 个 LP 通证可取回的储备，supply 需包含锁仓中的份额
+int64_t lp_burn_amount(int64_t reserve, int64_t shares, int64_t supply)
+{
+    eosio_assert(supply > 0 && shares <= supply, "invalid lp supply");
+    return int64_t(uint128_t(reserve) * shares / supply);
+}
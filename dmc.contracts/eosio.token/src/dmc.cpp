@@ -4,10 +4,11 @@
  */
 
 #include <eosio.token/eosio.token.hpp>
+#include <string.h>
 
 namespace eosio {
 
-void token::bill(account_name owner, extended_asset asset, double price, string memo)
+void token::bill(account_name owner, extended_asset asset, double price, uint64_t request_key, string memo)
 {
     require_auth(owner);
     eosio_assert(memo.size() <= 256, "memo has more than 256 bytes");
@@ -20,39 +21,138 @@ void token::bill(account_name owner, extended_asset asset, double price, string
     sub_balance(owner, asset);
     bill_stats sst(_self, owner);
 
-    auto hash = sha256<stake_id_args>({ owner, asset, price_t, now(), memo });
-    uint64_t bill_id = uint64_t(*reinterpret_cast<const uint64_t*>(&hash));
+    uint64_t bill_id = next_id(N(bill));
+    eosio_assert(sst.find(bill_id) == sst.end(), "bill id already exists");
+    add_request_key(owner, request_key, bill_id);
 
     sst.emplace(_self, [&](auto& r) {
-        r.primary = sst.available_primary_key();
         r.bill_id = bill_id;
         r.owner = owner;
-        r.unmatched = asset;
-        r.matched = extended_asset(0, pst_sym);
+        r.unmatched = asset.amount;
+        r.matched = 0;
         r.price = price_t;
         r.created_at = time_point_sec(now());
         r.updated_at = time_point_sec(now());
     });
+    change_bill_stats(owner, asset.amount, 0);
+    add_bill_expiry(owner, bill_id, time_point_sec(now()));
     SEND_INLINE_ACTION(*this, billrec, { _self, N(active) }, { owner, asset, bill_id, BILL });
 }
 
+void token::delreqkey(account_name owner, uint64_t key)
+{
+    request_keys key_tbl(_self, owner);
+    const auto& k = key_tbl.get(key, "no such request key");
+    uint64_t expiration = get_dmc_config(name { N(reqkeyexp) }, default_request_key_expiration);
+    if (k.created_at + expiration > time_point_sec(now()))
+        require_auth(owner);
+    key_tbl.erase(k);
+}
+
+uint64_t token::next_id(account_name sequence)
+{
+    id_sequences seq_tbl(_self, _self);
+    auto iter = seq_tbl.find(sequence);
+    if (iter == seq_tbl.end()) {
+        seq_tbl.emplace(_self, [&](auto& s) {
+            s.key = sequence;
+            s.next_id = 2;
+        });
+        return 1;
+    }
+
+    uint64_t id = iter->next_id;
+    seq_tbl.modify(iter, 0, [&](auto& s) {
+        s.next_id += 1;
+    });
+    return id;
+}
+
+// 登记客户端幂等键并记录分配的 id，重复提交会因幂等键已存在而失败；key 为 0 时不登记
+void token::add_request_key(account_name owner, uint64_t key, uint64_t id)
+{
+    if (key == 0)
+        return;
+    request_keys key_tbl(_self, owner);
+    eosio_assert(key_tbl.find(key) == key_tbl.end(), "duplicate request key");
+    key_tbl.emplace(owner, [&](auto& k) {
+        k.key = key;
+        k.id = id;
+        k.created_at = time_point_sec(now());
+    });
+}
+
 void token::unbill(account_name owner, uint64_t bill_id, string memo)
 {
     require_auth(owner);
     eosio_assert(memo.size() <= 256, "memo has more than 256 bytes");
+    migrate_bills(owner);
+    close_bill(owner, bill_id, owner);
+}
+
+// 结算激励后删除挂单，未成交的 PST 退还 owner
+void token::close_bill(account_name owner, uint64_t bill_id, account_name ram_payer)
+{
     bill_stats sst(_self, owner);
-    auto ust_idx = sst.get_index<N(byid)>();
-    auto ust = ust_idx.find(bill_id);
-    eosio_assert(ust != ust_idx.end(), "no such record");
-    extended_asset unmatched_asseet = ust->unmatched;
-    calbonus(owner, bill_id, owner);
-    ust_idx.erase(ust);
-    add_balance(owner, unmatched_asseet, owner);
+    auto ust = sst.find(bill_id);
+    eosio_assert(ust != sst.end(), "no such record");
+    extended_asset unmatched_asseet = extended_asset(ust->unmatched, pst_sym);
+    calbonus(owner, bill_id, ram_payer);
+    change_bill_stats(owner, -ust->unmatched, -ust->matched);
+    sst.erase(ust);
+    remove_bill_expiry(owner, bill_id);
+    add_balance(owner, unmatched_asseet, ram_payer);
 
     SEND_INLINE_ACTION(*this, billrec, { _self, N(active) }, { owner, unmatched_asseet, bill_id, UNBILL });
 }
 
-void token::order(account_name owner, account_name miner, uint64_t bill_id, extended_asset asset, extended_asset reserve, string memo)
+void token::expirebills(uint32_t limit)
+{
+    require_auth(eos_account);
+    eosio_assert(limit > 0, "limit must be positive");
+    bill_expiries expiry_tbl(_self, _self);
+    auto expiry_idx = expiry_tbl.get_index<N(byexpiry)>();
+    auto it = expiry_idx.begin();
+    for (uint32_t i = 0; i < limit && it != expiry_idx.end() && it->expire_at <= time_point_sec(now()); i++) {
+        account_name owner = it->owner;
+        uint64_t bill_id = it->bill_id;
+        bill_stats sst(_self, owner);
+        if (sst.find(bill_id) == sst.end()) {
+            it = expiry_idx.erase(it);
+            continue;
+        }
+        // 结算只修改已有余额记录，RAM 不由合约或调用者支付
+        it++;
+        if (!has_balance_record(owner, pst_sym) || !has_balance_record(owner, rsi_sym))
+            continue;
+        // close_bill 会同时删除到期索引
+        close_bill(owner, bill_id, owner);
+    }
+}
+
+void token::add_bill_expiry(account_name owner, uint64_t bill_id, time_point_sec created_at)
+{
+    uint64_t bill_dmc_claims_interval = get_dmc_config(name { N(billinter) }, default_bill_dmc_claims_interval);
+    bill_expiries expiry_tbl(_self, _self);
+    if (expiry_tbl.find(bill_id) != expiry_tbl.end())
+        return;
+
+    expiry_tbl.emplace(_self, [&](auto& e) {
+        e.bill_id = bill_id;
+        e.owner = owner;
+        e.expire_at = created_at + bill_dmc_claims_interval;
+    });
+}
+
+void token::remove_bill_expiry(account_name owner, uint64_t bill_id)
+{
+    bill_expiries expiry_tbl(_self, _self);
+    auto it = expiry_tbl.find(bill_id);
+    if (it != expiry_tbl.end() && it->owner == owner)
+        expiry_tbl.erase(it);
+}
+
+void token::order(account_name owner, account_name miner, uint64_t bill_id, extended_asset asset, extended_asset reserve, uint64_t request_key, string memo)
 {
     require_auth(owner);
     eosio_assert(memo.size() <= 256, "memo has more than 256 bytes");
@@ -60,37 +160,39 @@ void token::order(account_name owner, account_name miner, uint64_t bill_id, exte
     eosio_assert(asset.get_extended_symbol() == pst_sym, "only proof of service token can be ordered");
     eosio_assert(asset.amount > 0, "must order a positive amount");
     eosio_assert(reserve.amount >= 0, "reserve amount must >= 0");
-    require_recipient(owner);
-    require_recipient(miner);
+    notify_recipient(owner);
+    notify_recipient(miner);
 
+    migrate_bills(miner);
     bill_stats sst(_self, miner);
-    auto ust_idx = sst.get_index<N(byid)>();
-    auto ust = ust_idx.find(bill_id);
-    eosio_assert(ust != ust_idx.end(), "no such record");
-    eosio_assert(ust->unmatched >= asset, "overdrawn balance");
+    auto ust = sst.find(bill_id);
+    eosio_assert(ust != sst.end(), "no such record");
+    eosio_assert(ust->unmatched >= asset.amount, "overdrawn balance");
+    uint64_t bill_dmc_claims_interval = get_dmc_config(name { N(billinter) }, default_bill_dmc_claims_interval);
+    eosio_assert(ust->created_at + bill_dmc_claims_interval > time_point_sec(now()), "bill expired");
 
     double price = (double)ust->price / std::pow(2, 32);
     double dmc_amount = price * asset.amount;
     extended_asset user_to_pay = get_asset_by_amount<double, std::ceil>(dmc_amount, dmc_sym);
+    unlock_matured(owner, user_to_pay + reserve, owner);
     sub_balance(owner, user_to_pay + reserve);
 
     uint64_t now_time_t = calbonus(miner, bill_id, owner);
 
-    ust_idx.modify(ust, 0, [&](auto& s) {
-        s.unmatched -= asset;
-        s.matched += asset;
+    sst.modify(ust, 0, [&](auto& s) {
+        s.unmatched -= asset.amount;
+        s.matched += asset.amount;
         s.updated_at = time_point_sec(now_time_t);
     });
+    change_bill_stats(miner, -asset.amount, asset.amount);
 
     uint64_t claims_interval = get_dmc_config(name { N(claiminter) }, default_dmc_claims_interval);
 
     dmc_orders order_tbl(_self, _self);
-    auto hash = sha256<order_id_args>({ owner, miner, bill_id, asset, reserve, memo, time_point_sec(now()) });
-    uint64_t order_id = uint64_t(*reinterpret_cast<const uint64_t*>(&hash));
-    while (order_tbl.find(order_id) != order_tbl.end()) {
-        order_id += 1;
-    }
-    order_tbl.emplace(owner, [&](auto& o) {
+    uint64_t order_id = next_id(N(order));
+    eosio_assert(order_tbl.find(order_id) == order_tbl.end(), "order id already exists");
+    add_request_key(owner, request_key, order_id);
+    auto order_iter = order_tbl.emplace(owner, [&](auto& o) {
         o.order_id = order_id;
         o.user = owner;
         o.miner = miner;
@@ -104,6 +206,8 @@ void token::order(account_name owner, account_name miner, uint64_t bill_id, exte
         o.deliver_start_date = time_point_sec();
         o.latest_settlement_date = time_point_sec();
     });
+    if (is_stats_tracked(order_id))
+        change_dmc_stats(miner, get_order_aggregate(*order_iter));
 
     dmc_challenges challenge_tbl(_self, _self);
     challenge_tbl.emplace(owner, [&](auto& c) {
@@ -135,18 +239,23 @@ void token::increase(account_name owner, extended_asset asset, account_name mine
 
     sub_balance(owner, asset);
 
+    migrate_maker(miner);
     dmc_makers maker_tbl(_self, _self);
     auto iter = maker_tbl.find(miner);
     dmc_maker_pool dmc_pool(_self, miner);
     auto p_iter = dmc_pool.find(owner);
     if (iter == maker_tbl.end()) {
         if (owner == miner) {
+            pststats pst_acnts(_self, _self);
+            auto st = pst_acnts.find(miner);
+            int64_t total_pst = st != pst_acnts.end() ? st->amount.amount : 0;
             maker_tbl.emplace(miner, [&](auto& m) {
                 m.miner = owner;
-                m.current_rate = cal_current_rate(asset, miner);
+                m.current_rate = cal_current_rate(asset, total_pst);
                 m.miner_rate = 1;
                 m.total_weight = static_weights;
                 m.total_staked = asset;
+                m.total_pst = total_pst;
             });
 
             SEND_INLINE_ACTION(*this, makercharec, { _self, N(active) }, { owner, miner, asset, MakerReceiptIncrease });
@@ -164,7 +273,7 @@ void token::increase(account_name owner, extended_asset asset, account_name mine
         eosio_assert(new_weight > 0, "invalid new weight");
         eosio_assert(new_weight / total_weight > 0.0001, "increase too lower");
 
-        double r = cal_current_rate(new_total, miner);
+        double r = cal_current_rate(new_total, iter->total_pst);
         maker_tbl.modify(iter, 0, [&](auto& m) {
             m.total_weight = total_weight;
             m.total_staked = new_total;
@@ -195,6 +304,7 @@ void token::redemption(account_name owner, double rate, account_name miner)
     require_auth(owner);
 
     eosio_assert(rate > 0 && rate <= 1, "invaild rate");
+    migrate_maker(miner);
     dmc_makers maker_tbl(_self, _self);
     auto iter = maker_tbl.find(miner);
     eosio_assert(iter != maker_tbl.end(), "no such record");
@@ -230,7 +340,7 @@ void token::redemption(account_name owner, double rate, account_name miner)
     double total_weight = iter->total_weight - owner_weight;
     extended_asset total_staked = iter->total_staked - rede_quantity;
     double benchmark_stake_rate = get_dmc_rate(name { N(bmrate) }, default_benchmark_stake_rate);
-    double r = cal_current_rate(total_staked, miner);
+    double r = cal_current_rate(total_staked, iter->total_pst);
     if (miner == owner) {
         eosio_assert(r >= benchmark_stake_rate, "current stake rate less than benchmark stake rate, redemption fails");
         auto miner_iter = dmc_pool.find(miner);
@@ -238,7 +348,7 @@ void token::redemption(account_name owner, double rate, account_name miner)
         eosio_assert(miner_iter->weight / total_weight >= iter->miner_rate, "below the minimum rate");
     }
 
-    lock_add_balance(owner, rede_quantity, time_point_sec(now() + seconds_three_days), owner);
+    add_unbonding(owner, rede_quantity);
     SEND_INLINE_ACTION(*this, redeemrec, { _self, N(active) }, { owner, miner, rede_quantity });
 
     maker_tbl.modify(iter, 0, [&](auto& m) {
@@ -257,34 +367,79 @@ void token::redemption(account_name owner, double rate, account_name miner)
         eosio_assert(p_iter->weight / iter->total_weight > 0.0001, "The remaining weight is too low");
 }
 
+void token::claimunbond(account_name owner)
+{
+    require_auth(owner);
+
+    extended_asset released = release_unbonding(owner);
+    eosio_assert(released.amount > 0, "no matured unbonding");
+    add_balance(owner, released, owner);
+}
+
+void token::add_unbonding(account_name owner, extended_asset quantity)
+{
+    uint64_t granularity = get_dmc_config(name { N(unbondgran) }, default_unbond_granularity);
+    uint64_t release_at = now() + seconds_three_days;
+    release_at = (release_at + granularity - 1) / granularity * granularity;
+
+    unbond_queue queue(_self, owner);
+    auto it = queue.find(release_at);
+    if (it == queue.end()) {
+        queue.emplace(owner, [&](auto& u) {
+            u.release_at = time_point_sec(release_at);
+            u.quantity = quantity;
+        });
+    } else {
+        queue.modify(it, 0, [&](auto& u) {
+            u.quantity += quantity;
+        });
+    }
+}
+
+extended_asset token::release_unbonding(account_name owner, int64_t max_amount)
+{
+    unbond_queue queue(_self, owner);
+    auto now_time = time_point_sec(now());
+    extended_asset released = extended_asset(0, dmc_sym);
+    for (auto it = queue.begin(); it != queue.end() && it->release_at <= now_time && released.amount < max_amount;) {
+        int64_t needed = max_amount - released.amount;
+        if (it->quantity.amount <= needed) {
+            released += it->quantity;
+            it = queue.erase(it);
+        } else {
+            queue.modify(it, 0, [&](auto& u) {
+                u.quantity.amount -= needed;
+            });
+            released.amount += needed;
+        }
+    }
+    return released;
+}
+
 void token::mint(account_name owner, extended_asset asset)
 {
     require_auth(owner);
     eosio_assert(asset.amount > 0, "must mint a positive amount");
     eosio_assert(asset.get_extended_symbol() == pst_sym, "only PST can be minted");
 
+    migrate_maker(owner);
     dmc_makers maker_tbl(_self, _self);
     const auto& iter = maker_tbl.get(owner, "no such pst maker");
 
     //! refactor
     double makerd_pst = cal_makerd_pst(iter.total_staked);
-    extended_asset added_asset = asset;
-    pststats pst_acnts(_self, _self);
-
-    auto st = pst_acnts.find(owner);
-    if (st != pst_acnts.end())
-        added_asset += st->amount;
-
-    eosio_assert(std::floor(makerd_pst) >= added_asset.amount, "insufficient funds to mint");
+    int64_t total_pst = iter.total_pst + asset.amount;
+    eosio_assert(std::floor(makerd_pst) >= total_pst, "insufficient funds to mint");
 
     add_stats(asset);
     add_balance(owner, asset, owner);
     change_pst(owner, asset);
-    double r = cal_current_rate(iter.total_staked, owner);
+    double r = cal_current_rate(iter.total_staked, total_pst);
     double benchmark_stake_rate = get_dmc_rate(name { N(bmrate) }, default_benchmark_stake_rate);
     eosio_assert(r >= benchmark_stake_rate, "current stake rate less than benchmark stake rate, mint fails");
 
     maker_tbl.modify(iter, 0, [&](auto& m) {
+        m.total_pst = total_pst;
         m.current_rate = r;
     });
 }
@@ -293,6 +448,7 @@ void token::setmakerrate(account_name owner, double rate)
 {
     require_auth(owner);
     eosio_assert(rate >= 0.2 && rate <= 1, "invaild rate");
+    migrate_maker(owner);
     dmc_makers maker_tbl(_self, _self);
     const auto& iter = maker_tbl.get(owner, "no such record");
 
@@ -313,37 +469,95 @@ double token::cal_makerd_pst(extended_asset dmc_asset)
     return pst_amount;
 }
 
-double token::cal_current_rate(extended_asset dmc_asset, account_name owner)
+double token::cal_current_rate(extended_asset dmc_asset, int64_t total_pst)
 {
-    pststats pst_acnts(_self, _self);
     double r = 0.0;
-    auto st = pst_acnts.find(owner);
-    if (st != pst_acnts.end() && st->amount.amount != 0) {
-        r = (double)get_real_asset(dmc_asset) / st->amount.amount;
+    if (total_pst != 0) {
+        r = (double)get_real_asset(dmc_asset) / total_pst;
     } else {
         r = uint64_max;
     }
     return r;
 }
 
+// PST 变动时同步矿工记录中的 total_pst 与 current_rate
+void token::change_maker_pst(account_name miner, int64_t delta)
+{
+    migrate_maker(miner);
+    dmc_makers maker_tbl(_self, _self);
+    auto iter = maker_tbl.find(miner);
+    if (iter == maker_tbl.end())
+        return;
+
+    maker_tbl.modify(iter, 0, [&](auto& m) {
+        m.total_pst += delta;
+        m.current_rate = cal_current_rate(m.total_staked, m.total_pst);
+    });
+}
+
+void token::makermig(uint32_t limit)
+{
+    eosio_assert(limit > 0, "limit must be positive");
+    migrate_makers(limit);
+}
+
+void token::migrate_maker(account_name miner)
+{
+    legacy_dmc_makers legacy_tbl(_self, _self);
+    auto it = legacy_tbl.find(miner);
+    if (it == legacy_tbl.end())
+        return;
+
+    pststats pst_acnts(_self, _self);
+    auto st = pst_acnts.find(miner);
+    int64_t total_pst = st != pst_acnts.end() ? st->amount.amount : 0;
+
+    // 旧记录的 RAM 退还原付费账户，新记录由合约支付
+    dmc_makers maker_tbl(_self, _self);
+    maker_tbl.emplace(_self, [&](auto& m) {
+        m.miner = it->miner;
+        m.current_rate = it->current_rate;
+        m.miner_rate = it->miner_rate;
+        m.total_weight = it->total_weight;
+        m.total_staked = it->total_staked;
+        m.total_pst = total_pst;
+    });
+    legacy_tbl.erase(it);
+}
+
+void token::migrate_makers(uint64_t limit)
+{
+    legacy_dmc_makers legacy_tbl(_self, _self);
+    for (uint64_t i = 0; i < limit; i++) {
+        auto it = legacy_tbl.begin();
+        if (it == legacy_tbl.end())
+            break;
+        migrate_maker(it->miner);
+    }
+}
+
 void token::liquidation(string memo)
 {
     require_auth(eos_account);
+    // 排序前需要全部矿工记录都已迁移，未迁移完时本次只做迁移
+    migrate_makers(liquidation_migration_limit);
+    legacy_dmc_makers legacy_tbl(_self, _self);
+    if (legacy_tbl.begin() != legacy_tbl.end())
+        return;
+
     dmc_makers maker_tbl(_self, _self);
     auto maker_idx = maker_tbl.get_index<N(byrate)>();
 
     double n = get_dmc_rate(name { N(liqrate) }, default_liquidation_stake_rate);
     double m = get_dmc_rate(name { N(bmrate) }, default_benchmark_stake_rate);
-    pststats pst_acnts(_self, _self);
     constexpr uint64_t required_size = 20;
     std::vector<std::tuple<account_name /* miner */, extended_asset /* pst_asset */, extended_asset /* dmc_asset */>> liquidation_required;
     liquidation_required.reserve(required_size);
     for (auto maker_it = maker_idx.cbegin(); maker_it != maker_idx.cend() && maker_it->current_rate < n && liquidation_required.size() < required_size; maker_it++) {
         account_name owner = maker_it->miner;
         double r1 = maker_it->current_rate;
-        auto pst_it = pst_acnts.find(owner);
 
-        double sub_pst = (double)(1 - r1 / m) * get_real_asset(pst_it->amount);
+        double sub_pst = (double)(1 - r1 / m) * get_real_asset(extended_asset(maker_it->total_pst, pst_sym));
         extended_asset liq_pst_asset_leftover = get_asset_by_amount<double, std::ceil>(sub_pst, pst_sym);
         auto origin_liq_pst_asset = liq_pst_asset_leftover;
 
@@ -357,12 +571,14 @@ void token::liquidation(string memo)
             liq_pst_asset_leftover.amount = std::max((liq_pst_asset_leftover - pst_sub).amount, 0ll);
         }
 
+        // 未迁移的挂单留到之后的清算，矿工质押率仍不足时会再次被选中
+        migrate_bills(owner, liquidation_migration_limit);
         bill_stats sst(_self, owner);
         for (auto bit = sst.begin(); bit != sst.end() && liq_pst_asset_leftover.amount > 0;) {
             extended_asset sub_pst;
-            if (bit->unmatched <= liq_pst_asset_leftover) {
-                sub_pst = bit->unmatched;
-                liq_pst_asset_leftover -= bit->unmatched;
+            if (bit->unmatched <= liq_pst_asset_leftover.amount) {
+                sub_pst = extended_asset(bit->unmatched, pst_sym);
+                liq_pst_asset_leftover -= sub_pst;
             } else {
                 sub_pst = liq_pst_asset_leftover;
                 liq_pst_asset_leftover.amount = 0;
@@ -373,13 +589,15 @@ void token::liquidation(string memo)
             uint64_t now_time_t = calbonus(miner, bill_id, _self);
 
             sst.modify(bit, 0, [&](auto& r) {
-                r.unmatched -= sub_pst;
+                r.unmatched -= sub_pst.amount;
                 r.updated_at = time_point_sec(now_time_t);
             });
+            change_bill_stats(miner, -sub_pst.amount, bit->unmatched == 0 ? -bit->matched : 0);
 
-            if (bit->unmatched.amount == 0)
+            if (bit->unmatched == 0) {
+                remove_bill_expiry(miner, bill_id);
                 bit = sst.erase(bit);
-            else
+            } else
                 bit++;
 
             SEND_INLINE_ACTION(*this, makerliqrec, { _self, N(active) }, { miner, bill_id, sub_pst });
@@ -397,14 +615,15 @@ void token::liquidation(string memo)
         extended_asset pst;
         extended_asset dmc;
         std::tie(miner, pst, dmc) = liq;
-        auto pst_it = pst_acnts.find(miner);
         change_pst(miner, -pst);
         sub_stats(pst);
         auto iter = maker_tbl.find(miner);
         extended_asset new_staked = iter->total_staked - dmc;
-        double new_rate = cal_current_rate(new_staked, miner);
+        int64_t new_pst = iter->total_pst - pst.amount;
+        double new_rate = cal_current_rate(new_staked, new_pst);
         maker_tbl.modify(iter, 0, [&](auto& s) {
             s.total_staked = new_staked;
+            s.total_pst = new_pst;
             s.current_rate = new_rate;
         });
         SEND_INLINE_ACTION(*this, makercharec, { _self, N(active) }, { _self, miner, -dmc, MakerReceiptLiquidation });
@@ -416,11 +635,11 @@ void token::liquidation(string memo)
 void token::getincentive(account_name owner, uint64_t bill_id)
 {
     require_auth(owner);
+    migrate_bills(owner);
     uint64_t now_time_t = calbonus(owner, bill_id, owner);
     bill_stats sst(_self, owner);
-    auto ust_idx = sst.get_index<N(byid)>();
-    auto ust = ust_idx.find(bill_id);
-    ust_idx.modify(ust, 0, [&](auto& s) {
+    auto ust = sst.find(bill_id);
+    sst.modify(ust, 0, [&](auto& s) {
         s.updated_at = time_point_sec(now_time_t);
     });
 }
@@ -428,32 +647,128 @@ void token::getincentive(account_name owner, uint64_t bill_id)
 uint64_t token::calbonus(account_name owner, uint64_t bill_id, account_name ram_payer)
 {
     bill_stats sst(_self, owner);
-    auto ust_idx = sst.get_index<N(byid)>();
-    auto ust = ust_idx.find(bill_id);
-    eosio_assert(ust != ust_idx.end(), "no such record");
+    auto ust = sst.find(bill_id);
+    eosio_assert(ust != sst.end(), "no such record");
 
-    auto now_time = time_point_sec(now());
-    uint64_t now_time_t = now_time.sec_since_epoch();
-    uint64_t updated_at_t = ust->updated_at.sec_since_epoch();
     uint64_t bill_dmc_claims_interval = get_dmc_config(name { N(billinter) }, default_bill_dmc_claims_interval);
-    uint64_t max_dmc_claims_interval = ust->created_at.sec_since_epoch() + bill_dmc_claims_interval;
+    extended_asset quantity = get_asset_by_amount<double, std::floor>(get_dmc_config(name { N(bmrate) }, default_benchmark_stake_rate) / 100.0 / default_bill_dmc_claims_interval, rsi_sym);
+    int64_t amount = 0;
+    uint64_t now_time_t = accrue_incentive(*ust, bill_dmc_claims_interval, quantity.amount, amount);
+    quantity.amount = amount;
+    if (quantity.amount != 0) {
+        add_stats(quantity);
+        add_balance(owner, quantity, ram_payer);
+        SEND_INLINE_ACTION(*this, incentiverec, { _self, N(active) }, { owner, quantity, bill_id, 0, 0 });
+    }
+    return now_time_t;
+}
+
+// 计算挂单自上次结算以来累计的激励，返回本次结算到的时间
+uint64_t token::accrue_incentive(const bill_record& bill, uint64_t claims_interval, int64_t unit_amount, int64_t& amount)
+{
+    uint64_t now_time_t = now();
+    uint64_t updated_at_t = bill.updated_at.sec_since_epoch();
+    uint64_t max_dmc_claims_interval = bill.created_at.sec_since_epoch() + claims_interval;
 
     now_time_t = now_time_t >= max_dmc_claims_interval ? max_dmc_claims_interval : now_time_t;
 
+    amount = 0;
     if (updated_at_t <= max_dmc_claims_interval) {
         uint64_t duration = now_time_t - updated_at_t;
         eosio_assert(duration <= now_time_t, "subtractive overflow"); // never happened
+        amount = unit_amount * duration * bill.unmatched;
+    }
+    return now_time_t;
+}
+
+void token::claimallinc(account_name owner, uint64_t start_id, uint32_t limit)
+{
+    require_auth(owner);
+    eosio_assert(limit > 0, "limit must be positive");
+    migrate_bills(owner);
+
+    uint64_t bill_dmc_claims_interval = get_dmc_config(name { N(billinter) }, default_bill_dmc_claims_interval);
+    int64_t unit_amount = get_asset_by_amount<double, std::floor>(get_dmc_config(name { N(bmrate) }, default_benchmark_stake_rate) / 100.0 / default_bill_dmc_claims_interval, rsi_sym).amount;
 
-        extended_asset quantity = get_asset_by_amount<double, std::floor>(get_dmc_config(name { N(bmrate) }, default_benchmark_stake_rate) / 100.0 / default_bill_dmc_claims_interval, rsi_sym);
-        quantity.amount *= duration;
-        quantity.amount *= ust->unmatched.amount;
-        if (quantity.amount != 0) {
-            add_stats(quantity);
-            add_balance(owner, quantity, ram_payer);
-            SEND_INLINE_ACTION(*this, incentiverec, { _self, N(active) }, { owner, quantity, bill_id, 0, 0 });
+    bill_stats sst(_self, owner);
+    extended_asset total = extended_asset(0, rsi_sym);
+    uint32_t scanned = 0;
+    for (auto it = sst.lower_bound(start_id); it != sst.end() && scanned < limit; ++it, ++scanned) {
+        int64_t amount = 0;
+        uint64_t now_time_t = accrue_incentive(*it, bill_dmc_claims_interval, unit_amount, amount);
+        if (now_time_t <= it->updated_at.sec_since_epoch())
+            continue;
+
+        sst.modify(it, 0, [&](auto& s) {
+            s.updated_at = time_point_sec(now_time_t);
+        });
+        total += extended_asset(amount, rsi_sym);
+    }
+
+    if (total.amount != 0) {
+        add_stats(total);
+        add_balance(owner, total, owner);
+        SEND_INLINE_ACTION(*this, incentiverec, { _self, N(active) }, { owner, total, 0, 0, 0 });
+    }
+}
+
+void token::billmig(account_name owner, uint32_t limit)
+{
+    eosio_assert(limit > 0, "limit must be positive");
+    migrate_bills(owner, limit);
+}
+
+void token::migrate_bills(account_name owner, uint64_t limit)
+{
+    legacy_bill_stats legacy_sst(_self, owner);
+    auto it = legacy_sst.begin();
+    if (it == legacy_sst.end())
+        return;
+
+    bill_stats sst(_self, owner);
+    for (uint64_t i = 0; it != legacy_sst.end() && i < limit; i++) {
+        auto ust = sst.find(it->bill_id);
+        if (ust == sst.end()) {
+            sst.emplace(_self, [&](auto& r) {
+                r.bill_id = it->bill_id;
+                r.owner = it->owner;
+                r.matched = it->matched.amount;
+                r.unmatched = it->unmatched.amount;
+                r.price = it->price;
+                r.created_at = it->created_at;
+                r.updated_at = it->updated_at;
+            });
+            add_bill_expiry(owner, it->bill_id, it->created_at);
+        } else {
+            // 同一秒内参数完全相同的挂单 bill_id 相同，合并为一条
+            // 合并前两条记录各自结算激励，合并后从结算时间开始计算，避免按较早的时间对合并后的数量重复发放
+            eosio_assert(ust->price == it->price, "bill id collision");
+            uint64_t now_time_t = calbonus(owner, it->bill_id, _self);
+
+            bill_record legacy_bill = *ust;
+            legacy_bill.unmatched = it->unmatched.amount;
+            legacy_bill.created_at = it->created_at;
+            legacy_bill.updated_at = it->updated_at;
+            uint64_t bill_dmc_claims_interval = get_dmc_config(name { N(billinter) }, default_bill_dmc_claims_interval);
+            extended_asset quantity = get_asset_by_amount<double, std::floor>(get_dmc_config(name { N(bmrate) }, default_benchmark_stake_rate) / 100.0 / default_bill_dmc_claims_interval, rsi_sym);
+            int64_t amount = 0;
+            accrue_incentive(legacy_bill, bill_dmc_claims_interval, quantity.amount, amount);
+            quantity.amount = amount;
+            if (quantity.amount != 0) {
+                add_stats(quantity);
+                add_balance(owner, quantity, _self);
+                SEND_INLINE_ACTION(*this, incentiverec, { _self, N(active) }, { owner, quantity, it->bill_id, 0, 0 });
+            }
+
+            sst.modify(ust, 0, [&](auto& r) {
+                r.matched += it->matched.amount;
+                r.unmatched += it->unmatched.amount;
+                r.updated_at = time_point_sec(now_time_t);
+            });
         }
+        change_bill_stats(owner, it->unmatched.amount, it->matched.amount);
+        it = legacy_sst.erase(it);
     }
-    return now_time_t;
 }
 
 void token::setabostats(uint64_t stage, double user_rate, double foundation_rate, extended_asset total_release, time_point_sec start_at, time_point_sec end_at)
@@ -498,54 +813,59 @@ void token::setabostats(uint64_t stage, double user_rate, double foundation_rate
 
 void token::allocation(string memo)
 {
-    require_auth(eos_account);
     eosio_assert(memo.size() <= 256, "memo has more than 256 bytes");
     abostats ast(_self, _self);
     extended_asset to_foundation(0, dmc_sym);
     extended_asset to_user(0, dmc_sym);
 
+    // 一次遍历所有阶段，累计各阶段可释放的份额
     auto now_time = time_point_sec(now());
-    for (auto it = ast.begin(); it != ast.end();) {
+    for (auto it = ast.begin(); it != ast.end(); it++) {
+        if (now_time < it->start_at || it->remaining_release.amount == 0)
+            continue;
+
+        int64_t total_asset_amount = 0;
+        time_point_sec released_at = now_time;
         if (now_time > it->end_at) {
-            // 超过时间，但前一阶段仍然有份额没有增发完，一次性全部增发
-            if (it->remaining_release.amount != 0) {
-                to_foundation.amount = it->remaining_release.amount * it->foundation_rate;
-                to_user.amount = it->remaining_release.amount * it->user_rate;
-                ast.modify(it, 0, [&](auto& a) {
-                    a.last_released_at = it->end_at;
-                    a.remaining_release.amount = 0;
-                });
-            }
-            it++;
-        } else if (now_time < it->start_at) {
-            break;
+            // 超过时间，但该阶段仍然有份额没有增发完，一次性全部增发
+            total_asset_amount = it->remaining_release.amount;
+            released_at = it->end_at;
         } else {
             auto duration_time = now_time.sec_since_epoch() - it->last_released_at.sec_since_epoch();
             // 每天只能领取一次
             if (duration_time / 86400 == 0) // 24 * 60 * 60
-                break;
+                continue;
             auto remaining_time = it->end_at.sec_since_epoch() - it->last_released_at.sec_since_epoch();
             double per = (double)duration_time / (double)remaining_time;
             if (per > 1)
                 per = 1;
-            uint64_t total_asset_amount = per * it->remaining_release.amount;
-            if (total_asset_amount != 0) {
-                to_foundation.amount = total_asset_amount * it->foundation_rate;
-                to_user.amount = total_asset_amount * it->user_rate;
-                ast.modify(it, 0, [&](auto& a) {
-                    a.last_released_at = now_time;
-                    a.remaining_release.amount -= total_asset_amount;
-                });
-            }
-            break;
+            total_asset_amount = per * it->remaining_release.amount;
         }
+        if (total_asset_amount == 0)
+            continue;
+
+        int64_t foundation_amount = total_asset_amount * it->foundation_rate;
+        to_foundation.amount += foundation_amount;
+        to_user.amount += total_asset_amount - foundation_amount;
+        ast.modify(it, 0, [&](auto& a) {
+            a.last_released_at = released_at;
+            a.remaining_release.amount -= total_asset_amount;
+        });
     }
 
-    if (to_foundation.amount != 0 && to_user.amount != 0) {
-        SEND_INLINE_ACTION(*this, issue, { eos_account, N(active) }, { system_account, to_foundation, "allocation to foundation" });
+    // 直接记入基金会与 abo_account，不再经由 issue 内联调用，原 issue 的备注改由 allocrec 记录
+    if (to_foundation.amount != 0) {
+        add_stats(to_foundation);
+        add_balance(system_account, to_foundation, _self);
+        notify_recipient(system_account);
+        SEND_INLINE_ACTION(*this, allocrec, { _self, N(active) }, { system_account, to_foundation, string("allocation to foundation") });
+    }
+    if (to_user.amount != 0) {
+        add_stats(to_user);
+        add_balance(abo_account, to_user, _self);
+        notify_recipient(abo_account);
         auto dueto = now_time.sec_since_epoch() + 24 * 60 * 60;
-        string memo = uint32_to_string(dueto) + ";RSI@datamall";
-        SEND_INLINE_ACTION(*this, issue, { eos_account, N(active) }, { abo_account, to_user, memo });
+        SEND_INLINE_ACTION(*this, allocrec, { _self, N(active) }, { abo_account, to_user, uint32_to_string(dueto) + ";RSI@datamall" });
     }
 }
 
@@ -557,9 +877,23 @@ void token::setdmcconfig(account_name key, uint64_t value)
     case N(claiminter):
         eosio_assert(value > 0, "invalid claims interval");
         break;
+    case N(unbondgran):
+        eosio_assert(value > 0, "invalid unbond granularity");
+        break;
+    case N(sampleinter):
+        eosio_assert(value > 0, "invalid sample interval");
+        break;
+    case N(samplecall):
+        eosio_assert(value > 0, "invalid sample limit per call");
+        break;
+    case N(reqkeyexp):
+        eosio_assert(value > 0, "invalid request key expiration");
+        break;
     default:
         break;
     }
+    if (key == N(closezero))
+        closezero_cache = value != 0 ? 1 : 0;
     auto config_itr = dmc_global_tbl.find(key);
     if (config_itr == dmc_global_tbl.end()) {
         dmc_global_tbl.emplace(_self, [&](auto& conf) {
@@ -642,6 +976,7 @@ void token::trace_price_history(double price, uint64_t bill_id)
 
 void token::cleanpst(string memo)
 {
+    migrate_makers();
     pststats pst_acnts(_self, _self);
     std::vector<std::tuple<account_name /* owner */, extended_asset /* pst_asset */>> clean_required;
 
@@ -655,12 +990,15 @@ void token::cleanpst(string memo)
             auto account_idx = acnts.get_index<N(byextendedasset)>();
             auto account_it = account_idx.find(account::key(pst_sym));
             if (account_it != account_idx.end()) {
-                sub_balance(miner, account_it->balance);
                 pst = account_it->balance;
+                sub_balance(miner, pst);
             }
+            migrate_bills(miner);
             bill_stats sst(_self, miner);
             for (auto bit = sst.begin(); bit != sst.end();) {
-                pst += bit->unmatched;
+                pst += extended_asset(bit->unmatched, pst_sym);
+                change_bill_stats(miner, -bit->unmatched, -bit->matched);
+                remove_bill_expiry(miner, bit->bill_id);
                 bit = sst.erase(bit);
             }
             clean_required.emplace_back(std::make_tuple(it->owner, pst));
@@ -671,7 +1009,6 @@ void token::cleanpst(string memo)
         account_name owner;
         extended_asset pst;
         std::tie(owner, pst) = cle;
-        auto pst_it = pst_acnts.find(owner);
         change_pst(owner, -pst);
         sub_stats(pst);
     }
@@ -1,4 +1,5 @@
 #include <eosio.token/eosio.token.hpp>
+#include <eosiolib/transaction.h>
 #include <string.h>
 
 namespace eosio {
@@ -57,6 +58,7 @@ void token::addmerkle(name sender, uint64_t order_id, checksum256 merkle_root, u
 
             dmc_order order = *order_iter;
             update_order(order, *challenge_iter, sender);
+            change_order_stats(*order_iter, order);
             order_tbl.modify(order_iter, sender, [&](auto& o) {
                 o = order;
             });
@@ -96,10 +98,12 @@ void token::reqchallenge(name sender, uint64_t order_id, uint64_t data_id, check
     //预扣除挑战需要的 dmc
     eosio_assert(order.user_pledge >= user_lock, "not enough dmc to challenge");
     order.user_pledge -= user_lock;
+    change_order_stats(*order_iter, order);
     order_tbl.modify(order_iter, sender, [&](auto& o) {
         o = order;
     });
 
+    change_challenge_stats(order, challenge_iter->state, ChallengeRequest);
     challenge_tbl.modify(challenge_iter, sender, [&](auto& c) {
         c.data_id = data_id;
         c.hash_data = hash_data;
@@ -109,6 +113,19 @@ void token::reqchallenge(name sender, uint64_t order_id, uint64_t data_id, check
         c.challenge_date = time_point_sec(now());
         c.user_lock += user_lock;
     });
+
+    challenge_requests req_tbl(_self, _self);
+    auto req_iter = req_tbl.find(order_id);
+    if (req_iter == req_tbl.end()) {
+        req_tbl.emplace(sender, [&](auto& r) {
+            r.order_id = order_id;
+            r.challenge_date = time_point_sec(now());
+        });
+    } else {
+        req_tbl.modify(req_iter, 0, [&](auto& r) {
+            r.challenge_date = time_point_sec(now());
+        });
+    }
     SEND_INLINE_ACTION(*this, ordercharec, { _self, N(active) },
         { order_id, -user_lock, extended_asset(0, dmc_sym), extended_asset(0, dmc_sym), user_lock, time_point_sec(now()), OrderReceiptChallengeReq });
 }
@@ -145,6 +162,8 @@ void token::anschallenge(name sender, uint64_t order_id, checksum256 reply_hash)
         { order_id, challenge_iter->user_lock - user_pay, extended_asset(0, dmc_sym),
             extended_asset(0, dmc_sym), user_pay - challenge_iter->user_lock, time_point_sec(now()), OrderReceiptChallengeAns });
 
+    change_challenge_stats(order, challenge_iter->state, ChallengeAnswer);
+    remove_challenge_request(order_id);
     challenge_tbl.modify(challenge_iter, sender, [&](auto& c) {
         c.state = ChallengeAnswer;
         c.user_lock = extended_asset(0, dmc_sym);
@@ -152,6 +171,7 @@ void token::anschallenge(name sender, uint64_t order_id, checksum256 reply_hash)
     });
 
     update_order(order, *challenge_iter, sender);
+    change_order_stats(*order_iter, order);
     order_tbl.modify(order_iter, sender, [&](auto& o) {
         o = order;
     });
@@ -170,30 +190,13 @@ void token::arbitration(name sender, uint64_t order_id, const std::vector<char>&
     auto challenge_iter = challenge_tbl.find(order_id);
     eosio_assert(challenge_iter != challenge_tbl.end(), "can't find challenge");
 
+    eosio_assert(is_merkle_proof_valid(challenge_iter->merkle_root, challenge_iter->data_id, data, cut_merkle), "merkle root mismatch!");
     std::vector<char> copy_data = data;
-    checksum256 checksum_data;
-    ::sha256((char*)&copy_data[0], copy_data.size(), &checksum_data);
     copy_data.insert(copy_data.end(), challenge_iter->nonce.begin(), challenge_iter->nonce.end());
     checksum256 pre_hash_data;
     ::sha256((char*)&copy_data[0], copy_data.size(), &pre_hash_data);
     checksum256 hash_data;
     ::sha256((char*)&pre_hash_data.hash[0], sizeof(pre_hash_data), &hash_data);
-    uint64_t id_tmp = challenge_iter->data_id;
-
-    for (auto iter = cut_merkle.begin(); iter != cut_merkle.end(); iter++) {
-        std::vector<char> mixed_hash;
-        auto pos = id_tmp % 2;
-        if (!pos) {
-            mixed_hash.insert(mixed_hash.begin(), &checksum_data.hash[0], (&checksum_data.hash[0]) + sizeof(checksum_data.hash));
-            mixed_hash.insert(mixed_hash.begin() + sizeof(checksum_data.hash), &(iter->hash[0]), (&(iter->hash[0])) + sizeof(iter->hash));
-        } else {
-            mixed_hash.insert(mixed_hash.begin(), &(iter->hash[0]), (&(iter->hash[0])) + sizeof(iter->hash));
-            mixed_hash.insert(mixed_hash.begin() + sizeof(checksum_data.hash), &checksum_data.hash[0], (&checksum_data.hash[0]) + sizeof(checksum_data.hash));
-        }
-        ::sha256((char*)&mixed_hash[0], mixed_hash.size(), &checksum_data);
-        id_tmp /= 2;
-    }
-    eosio_assert(is_equal_checksum256(checksum_data, challenge_iter->merkle_root), "merkle root mismatch!");
 
     // 计算订单 pst 单价的 10%
     auto per_price_amount = double(order_iter->price.amount) * 0.1 / (order_iter->miner_pledge.amount / pow(10, pst_sym.precision()));
@@ -220,6 +223,8 @@ void token::arbitration(name sender, uint64_t order_id, const std::vector<char>&
                 extended_asset(0, dmc_sym), user_pay - challenge_iter->user_lock, time_point_sec(now()), OrderReceiptChallengeArb });
     }
 
+    change_challenge_stats(order, challenge_iter->state, state);
+    remove_challenge_request(order_id);
     challenge_tbl.modify(challenge_iter, sender, [&](auto& o) {
         o.state = state;
         o.user_lock = extended_asset(0, dmc_sym);
@@ -227,6 +232,7 @@ void token::arbitration(name sender, uint64_t order_id, const std::vector<char>&
     });
 
     update_order(order, *challenge_iter, sender);
+    change_order_stats(*order_iter, order);
     order_tbl.modify(order_iter, sender, [&](auto& o) {
         o = order;
     });
@@ -235,19 +241,241 @@ void token::arbitration(name sender, uint64_t order_id, const std::vector<char>&
 void token::paychallenge(name sender, uint64_t order_id)
 {
     require_auth(sender);
+    uint64_t challenge_interval = get_dmc_config(name { N(challinter) }, default_dmc_challenge_interval);
+    dmc_challenges challenge_tbl(_self, _self);
+    auto challenge_iter = challenge_tbl.find(order_id);
+    eosio_assert(challenge_iter != challenge_tbl.end(), "can't find challenge");
+    eosio_assert(challenge_iter->state == ChallengeRequest, "invalid state, can't pay challenge!");
+    eosio_assert(challenge_iter->challenge_date + challenge_interval <= time_point_sec(now()), "challange doesn't reach expire time!");
+    settle_challenge_timeout(order_id, sender);
+}
 
+void token::sweepchall(uint32_t limit)
+{
+    eosio_assert(limit > 0, "limit must be positive");
+    uint64_t challenge_interval = get_dmc_config(name { N(challinter) }, default_dmc_challenge_interval);
+    challenge_requests req_tbl(_self, _self);
+    auto req_idx = req_tbl.get_index<N(bydate)>();
+    for (uint32_t i = 0; i < limit; i++) {
+        auto it = req_idx.begin();
+        if (it == req_idx.end() || it->challenge_date + challenge_interval > time_point_sec(now()))
+            break;
+        // 结算时会删除队列中的记录
+        settle_challenge_timeout(it->order_id, _self);
+    }
+}
+
+void token::samplechall(uint32_t limit)
+{
+    require_auth(eos_account);
+    eosio_assert(limit > 0, "limit must be positive");
+    eosio_assert(limit <= get_dmc_config(name { N(samplecall) }, default_sample_per_call), "too many samples in one call");
+    uint64_t sample_interval = get_dmc_config(name { N(sampleinter) }, default_sample_interval);
+    uint64_t sample_count = get_dmc_config(name { N(samplecnt) }, default_sample_count);
+    auto now_time = time_point_sec(now());
+
+    sample_states state_tbl(_self, _self);
+    auto state_iter = state_tbl.begin();
+    if (state_iter == state_tbl.end()) {
+        state_iter = state_tbl.emplace(_self, [&](auto& s) {
+            s.period_start = now_time;
+            s.sampled = 0;
+            s.seed = 0;
+        });
+    }
+    sample_state state = *state_iter;
+    if (state.period_start + sample_interval <= now_time) {
+        state.period_start = now_time;
+        state.sampled = 0;
+    }
+    eosio_assert(state.sampled < sample_count, "sample quota of this period is used up");
+
+    // TaPoS 信息与上一次的种子串联，单笔交易无法独自决定抽查结果
+    checksum256 seed_hash = sample_hash(state.seed, ((uint64_t)(uint32_t)tapos_block_prefix() << 32) | (uint32_t)tapos_block_num());
+    memcpy(&state.seed, &seed_hash.hash[0], sizeof(state.seed));
+
+    // 在可抽查订单的稠密编号上均匀取值，与 order_id 的分布无关
+    dmc_orders order_tbl(_self, _self);
+    dmc_challenges challenge_tbl(_self, _self);
+    challenge_samples sample_tbl(_self, _self);
+    sample_indexes index_tbl(_self, _self);
+    if (index_tbl.begin() != index_tbl.end()) {
+        uint64_t eligible_count = (--index_tbl.end())->position + 1;
+        for (uint32_t i = 0; i < limit && state.sampled < sample_count; i++) {
+            checksum256 hash = sample_hash(state.seed, i);
+            uint64_t order_rand = 0;
+            uint64_t data_rand = 0;
+            memcpy(&order_rand, &hash.hash[0], sizeof(order_rand));
+            memcpy(&data_rand, &hash.hash[8], sizeof(data_rand));
+
+            const auto& index = index_tbl.get(order_rand % eligible_count, "sample index is not dense");
+            auto order_iter = order_tbl.find(index.order_id);
+            eosio_assert(order_iter != order_tbl.end() && is_sample_eligible(order_iter->state), "sample index mismatch");
+            auto challenge_iter = challenge_tbl.find(order_iter->order_id);
+            if (challenge_iter == challenge_tbl.end() || !is_challenge_end(challenge_iter->state) || challenge_iter->data_block_count == 0)
+                continue;
+            if (sample_tbl.find(order_iter->order_id) != sample_tbl.end())
+                continue;
+
+            sample_tbl.emplace(_self, [&](auto& s) {
+                s.order_id = order_iter->order_id;
+                s.miner = order_iter->miner;
+                s.data_id = data_rand % challenge_iter->data_block_count;
+                s.created_at = now_time;
+            });
+            state.sampled++;
+        }
+    }
+
+    state_tbl.modify(state_iter, 0, [&](auto& s) {
+        s = state;
+    });
+}
+
+void token::anssamples(name sender, std::vector<sample_proof> proofs)
+{
+    require_auth(sender);
+    eosio_assert(!proofs.empty() && proofs.size() <= 100, "must answer 1 to 100 samples");
+    uint64_t challenge_interval = get_dmc_config(name { N(challinter) }, default_dmc_challenge_interval);
+    challenge_samples sample_tbl(_self, _self);
+    dmc_challenges challenge_tbl(_self, _self);
+    for (const auto& p : proofs) {
+        auto sample_iter = sample_tbl.find(p.order_id);
+        eosio_assert(sample_iter != sample_tbl.end(), "can't find sample");
+        eosio_assert(sample_iter->miner == sender, "only miner can answer sample");
+        eosio_assert(sample_iter->created_at + challenge_interval > time_point_sec(now()), "sample is expired");
+        auto challenge_iter = challenge_tbl.find(p.order_id);
+        eosio_assert(challenge_iter != challenge_tbl.end(), "can't find challenge");
+        eosio_assert(is_merkle_proof_valid(challenge_iter->merkle_root, sample_iter->data_id, p.data, p.cut_merkle), "merkle root mismatch!");
+        sample_tbl.erase(sample_iter);
+    }
+}
+
+void token::sweepsample(uint32_t limit)
+{
+    eosio_assert(limit > 0, "limit must be positive");
+    uint64_t challenge_interval = get_dmc_config(name { N(challinter) }, default_dmc_challenge_interval);
+    challenge_samples sample_tbl(_self, _self);
+    auto sample_idx = sample_tbl.get_index<N(bydate)>();
+    dmc_orders order_tbl(_self, _self);
+    dmc_challenges challenge_tbl(_self, _self);
+    for (uint32_t i = 0; i < limit; i++) {
+        auto it = sample_idx.begin();
+        if (it == sample_idx.end() || it->created_at + challenge_interval > time_point_sec(now()))
+            break;
+        uint64_t order_id = it->order_id;
+        sample_idx.erase(it);
+
+        auto order_iter = order_tbl.find(order_id);
+        auto challenge_iter = challenge_tbl.find(order_id);
+        if (order_iter == order_tbl.end() || challenge_iter == challenge_tbl.end())
+            continue;
+        auto order = *order_iter;
+        update_order(order, *challenge_iter, name { _self });
+        change_order_stats(*order_iter, order);
+        order_tbl.modify(order_iter, 0, [&](auto& o) {
+            o = order;
+        });
+
+        // 已结束的订单不再处罚，用户发起的挑战由 paychallenge / sweepchall 处理
+        if (order.state != OrderStateDeliver && order.state != OrderStatePreCont && order.state != OrderStatePreEnd)
+            continue;
+        if (!is_challenge_end(challenge_iter->state))
+            continue;
+        settle_challenge_timeout(order_id, _self);
+    }
+}
+
+// 由数据块与默克尔剪枝树逐层计算根哈希，并与 merkle_root 比较
+bool token::is_merkle_proof_valid(const checksum256& merkle_root, uint64_t data_id, const std::vector<char>& data, const std::vector<checksum256>& cut_merkle)
+{
+    checksum256 checksum_data;
+    ::sha256((char*)data.data(), data.size(), &checksum_data);
+    uint64_t id_tmp = data_id;
+
+    for (auto iter = cut_merkle.begin(); iter != cut_merkle.end(); iter++) {
+        std::vector<char> mixed_hash;
+        auto pos = id_tmp % 2;
+        if (!pos) {
+            mixed_hash.insert(mixed_hash.begin(), &checksum_data.hash[0], (&checksum_data.hash[0]) + sizeof(checksum_data.hash));
+            mixed_hash.insert(mixed_hash.begin() + sizeof(checksum_data.hash), &(iter->hash[0]), (&(iter->hash[0])) + sizeof(iter->hash));
+        } else {
+            mixed_hash.insert(mixed_hash.begin(), &(iter->hash[0]), (&(iter->hash[0])) + sizeof(iter->hash));
+            mixed_hash.insert(mixed_hash.begin() + sizeof(checksum_data.hash), &checksum_data.hash[0], (&checksum_data.hash[0]) + sizeof(checksum_data.hash));
+        }
+        ::sha256((char*)&mixed_hash[0], mixed_hash.size(), &checksum_data);
+        id_tmp /= 2;
+    }
+    return is_equal_checksum256(checksum_data, merkle_root);
+}
+
+bool token::is_sample_eligible(OrderState state)
+{
+    return state == OrderStateDeliver || state == OrderStatePreCont || state == OrderStatePreEnd;
+}
+
+void token::add_sample_index(uint64_t order_id)
+{
+    sample_indexes index_tbl(_self, _self);
+    auto order_idx = index_tbl.get_index<N(orderid)>();
+    if (order_idx.find(order_id) != order_idx.end())
+        return;
+
+    uint64_t position = index_tbl.begin() == index_tbl.end() ? 0 : (--index_tbl.end())->position + 1;
+    index_tbl.emplace(_self, [&](auto& s) {
+        s.position = position;
+        s.order_id = order_id;
+    });
+}
+
+void token::remove_sample_index(uint64_t order_id)
+{
+    sample_indexes index_tbl(_self, _self);
+    auto order_idx = index_tbl.get_index<N(orderid)>();
+    auto order_iter = order_idx.find(order_id);
+    if (order_iter == order_idx.end())
+        return;
+
+    auto last_iter = --index_tbl.end();
+    uint64_t position = order_iter->position;
+    if (last_iter->position != position) {
+        uint64_t last_order_id = last_iter->order_id;
+        index_tbl.erase(last_iter);
+        index_tbl.modify(index_tbl.get(position), 0, [&](auto& s) {
+            s.order_id = last_order_id;
+        });
+    } else {
+        index_tbl.erase(last_iter);
+    }
+}
+
+checksum256 token::sample_hash(uint64_t seed, uint64_t index)
+{
+    uint64_t words[3] = { seed, index, now() };
+    checksum256 hash;
+    ::sha256((const char*)words, sizeof(words), &hash);
+    return hash;
+}
+
+void token::remove_challenge_request(uint64_t order_id)
+{
+    challenge_requests req_tbl(_self, _self);
+    auto req_iter = req_tbl.find(order_id);
+    if (req_iter != req_tbl.end())
+        req_tbl.erase(req_iter);
+}
+
+void token::settle_challenge_timeout(uint64_t order_id, account_name sender)
+{
     dmc_orders order_tbl(_self, _self);
     auto order_iter = order_tbl.find(order_id);
     eosio_assert(order_iter != order_tbl.end(), "can't find order");
-    uint64_t challenge_interval = get_dmc_config(name { N(challinter) }, default_dmc_challenge_interval);
     dmc_challenges challenge_tbl(_self, _self);
     auto challenge_iter = challenge_tbl.find(order_id);
     eosio_assert(challenge_iter != challenge_tbl.end(), "can't find challenge");
-
-    eosio_assert(challenge_iter->state == ChallengeRequest, "invalid state, can't pay challenge!");
-    eosio_assert(challenge_iter->challenge_date + challenge_interval <= time_point_sec(now()), "challange doesn't reach expire time!");
     destory_pst(*order_iter);
 
+    migrate_maker(order_iter->miner);
     dmc_makers maker_tbl(_self, _self);
     auto iter = maker_tbl.find(order_iter->miner);
     eosio_assert(iter != maker_tbl.end(), "cannot find miner in dmc maker");
@@ -280,12 +508,18 @@ void token::paychallenge(name sender, uint64_t order_id)
     SEND_INLINE_ACTION(*this, ordercharec, { _self, N(active) },
         { order_id, miner_arbitration - system_reward,
             zero_dmc, zero_dmc, zero_dmc, time_point_sec(now()), OrderReceiptChallengePayReward });
+    auto order = *order_iter;
+    order.user_pledge += challenge_iter->user_lock + order.lock_pledge + (miner_arbitration - system_reward);
+    order.lock_pledge = extended_asset(0, order.lock_pledge.get_extended_symbol());
+    order.state = OrderStateEnd;
+    change_order_stats(*order_iter, order);
     order_tbl.modify(order_iter, sender, [&](auto& o) {
-        o.user_pledge += challenge_iter->user_lock + o.lock_pledge + (miner_arbitration - system_reward);
-        o.lock_pledge = extended_asset(0, o.lock_pledge.get_extended_symbol());
-        o.state = OrderStateEnd;
+        o = order;
     });
 
+    change_challenge_stats(order, challenge_iter->state, ChallengeTimeout);
+    remove_challenge_request(order_id);
+    remove_order_autopay(order_id);
     challenge_tbl.modify(challenge_iter, sender, [&](auto& c) {
         c.state = ChallengeTimeout;
         c.user_lock = extended_asset(0, c.user_lock.get_extended_symbol());
@@ -24,6 +24,9 @@ void token::change_order(dmc_order& order, const dmc_challenge& challenge, time_
         if (order.latest_settlement_date + per_claims_interval > current) {
             return;
         }
+        if (order.user_pledge < order.price) {
+            topup_order_pledge(order);
+        }
         if (order.user_pledge >= order.price) {
             order.user_pledge -= order.price;
             order.lock_pledge += order.price;
@@ -52,6 +55,7 @@ void token::change_order(dmc_order& order, const dmc_challenge& challenge, time_
         order.state = OrderStateEnd;
         order.latest_settlement_date += claims_interval;
         destory_pst(order);
+        remove_order_autopay(order.order_id);
         SEND_INLINE_ACTION(*this, ordercharec, { _self, N(active) },
             { order.order_id, zero_dmc, -order.price, order.price, zero_dmc, order.latest_settlement_date, OrderReceiptUpdate });
         if (order.lock_pledge.amount > 0) {
@@ -64,6 +68,48 @@ void token::change_order(dmc_order& order, const dmc_challenge& challenge, time_
     }
 }
 
+// 开启自动续费的订单，从用户余额补足下一周期的费用，额度或余额不足时不扣除
+void token::topup_order_pledge(dmc_order& order)
+{
+    order_autopays autopay_tbl(_self, _self);
+    auto autopay_iter = autopay_tbl.find(order.order_id);
+    if (autopay_iter == autopay_tbl.end()) {
+        return;
+    }
+
+    extended_asset topup = order.price - order.user_pledge;
+    if (autopay_iter->remaining < topup) {
+        return;
+    }
+    // 先判断可用余额与到期锁仓是否足够，不足时不做任何解锁
+    extended_asset balance = get_balance(topup, order.user);
+    if (balance < topup) {
+        if (balance + get_matured_balance(order.user, topup.get_extended_symbol()) < topup) {
+            return;
+        }
+        // 由 keeper 等第三方触发时没有用户授权，新建的余额记录由合约支付
+        unlock_matured(order.user, topup, _self);
+    }
+
+    sub_balance(order.user, topup);
+    order.user_pledge += topup;
+    autopay_tbl.modify(autopay_iter, 0, [&](auto& a) {
+        a.remaining -= topup;
+    });
+    extended_asset zero_dmc = extended_asset(0, dmc_sym);
+    SEND_INLINE_ACTION(*this, ordercharec, { _self, N(active) },
+        { order.order_id, topup, zero_dmc, zero_dmc, zero_dmc, time_point_sec(now()), OrderReceiptUser });
+}
+
+void token::remove_order_autopay(uint64_t order_id)
+{
+    order_autopays autopay_tbl(_self, _self);
+    auto autopay_iter = autopay_tbl.find(order_id);
+    if (autopay_iter != autopay_tbl.end()) {
+        autopay_tbl.erase(autopay_iter);
+    }
+}
+
 void token::update_order(dmc_order& order, const dmc_challenge& challenge, name payer)
 {
     auto current_time = time_point_sec(now());
@@ -80,21 +126,24 @@ void token::update_order(dmc_order& order, const dmc_challenge& challenge, name
 
 void token::destory_pst(const dmc_order& info)
 {
+    migrate_maker(info.miner);
     dmc_makers maker_tbl(_self, _self);
     auto iter = maker_tbl.find(info.miner);
     eosio_assert(iter != maker_tbl.end(), "cannot find miner in dmc maker");
     sub_stats(info.miner_pledge);
     change_pst(info.miner, -(info.miner_pledge));
     maker_tbl.modify(iter, 0, [&](auto& m) {
-        m.current_rate = cal_current_rate(iter->total_staked, info.miner);
+        m.total_pst -= info.miner_pledge.amount;
+        m.current_rate = cal_current_rate(m.total_staked, m.total_pst);
     });
+    migrate_bills(info.miner);
     bill_stats sst(_self, info.miner);
-    auto ust_idx = sst.get_index<N(byid)>();
-    auto ust = ust_idx.find(info.bill_id);
-    if (ust != ust_idx.end()) {
-        ust_idx.modify(ust, 0, [&](auto& s) {
-            s.matched -= info.miner_pledge;
+    auto ust = sst.find(info.bill_id);
+    if (ust != sst.end()) {
+        sst.modify(ust, 0, [&](auto& s) {
+            s.matched -= info.miner_pledge.amount;
         });
+        change_bill_stats(info.miner, 0, -info.miner_pledge.amount);
     }
 }
 
@@ -103,6 +152,7 @@ void token::claim_dmc_reward(const dmc_order& info, dmc_challenge& challenge, ac
     double benchmark_stake_rate = get_dmc_config(name { N(bmrate) }, default_benchmark_stake_rate) / 100.0;
     auto miner_pledge_amount = extended_asset(round(info.settlement_pledge.amount * miner_scale), info.settlement_pledge.get_extended_symbol());
     auto lp_pledge_amount = info.settlement_pledge - miner_pledge_amount;
+    migrate_maker(info.miner);
     dmc_makers maker_tbl(_self, _self);
     auto iter = maker_tbl.find(info.miner);
     eosio_assert(iter != maker_tbl.end(), "cannot find miner in dmc maker");
@@ -120,8 +170,9 @@ void token::claim_dmc_reward(const dmc_order& info, dmc_challenge& challenge, ac
 
     SEND_INLINE_ACTION(*this, orderclarec, { _self, N(active) }, { info.miner, miner_pledge_amount, info.bill_id, info.order_id });
 
-    uint64_t epoch = std::round((double)info.settlement_pledge.amount / info.price.amount);
-    auto user_reward = extended_asset(round(double(info.miner_pledge.amount * epoch) * pow(10, rsi_sym.precision() - info.miner_pledge.get_extended_symbol().precision())), rsi_sym);
+    // 按结算额折算周期数，resizeorder 结算的不足一个周期部分按比例发放
+    double epoch = (double)info.settlement_pledge.amount / info.price.amount;
+    auto user_reward = extended_asset(round(double(info.miner_pledge.amount) * epoch * pow(10, rsi_sym.precision() - info.miner_pledge.get_extended_symbol().precision())), rsi_sym);
     auto miner_reward = extended_asset(round(user_reward.amount * (1 + benchmark_stake_rate)), rsi_sym);
     add_balance(info.user, user_reward, payer);
     SEND_INLINE_ACTION(*this, incentiverec, { _self, N(active) }, { info.user, user_reward, info.bill_id, info.order_id, 1 });
@@ -147,6 +198,7 @@ void token::updateorder(name payer, uint64_t order_id)
     auto order_info = *order_iter;
     update_order(order_info, *challenge_iter, payer);
 
+    change_order_stats(*order_iter, order_info);
     order_tbl.modify(order_iter, payer, [&](auto& o) {
         o = order_info;
     });
@@ -170,6 +222,7 @@ void token::claimorder(name payer, uint64_t order_id)
     claim_dmc_reward(order_info, challenge, payer);
     order_info.settlement_pledge = extended_asset(0, order_info.settlement_pledge.get_extended_symbol());
 
+    change_order_stats(*order_iter, order_info);
     order_tbl.modify(order_iter, payer, [&](auto& o) {
         o = order_info;
     });
@@ -195,6 +248,7 @@ void token::addordasset(name sender, uint64_t order_id, extended_asset quantity)
     sub_balance(sender, quantity);
 
     order_info.user_pledge += quantity;
+    change_order_stats(*order_iter, order_info);
     order_tbl.modify(order_iter, sender, [&](auto& o) {
         o = order_info;
     });
@@ -220,6 +274,7 @@ void token::subordasset(name sender, uint64_t order_id, extended_asset quantity)
     add_balance(sender, quantity, sender);
 
     order_info.user_pledge -= quantity;
+    change_order_stats(*order_iter, order_info);
     order_tbl.modify(order_iter, sender, [&](auto& o) {
         o = order_info;
     });
@@ -229,6 +284,119 @@ void token::subordasset(name sender, uint64_t order_id, extended_asset quantity)
         { order_id, -quantity, zero_dmc, zero_dmc, zero_dmc, time_point_sec(now()), OrderReceiptUser });
 }
 
+void token::resizeorder(name sender, uint64_t order_id, extended_asset delta_pst)
+{
+    require_auth(sender);
+    eosio_assert(delta_pst.get_extended_symbol() == pst_sym, "only proof of service token can be resized");
+    eosio_assert(delta_pst.amount != 0, "delta must not be zero");
+    dmc_orders order_tbl(_self, _self);
+    auto order_iter = order_tbl.find(order_id);
+    eosio_assert(order_iter != order_tbl.end(), "can't find order");
+    eosio_assert(order_iter->user == sender, "only user can resize order");
+    dmc_challenges challenge_tbl(_self, _self);
+    auto challenge_iter = challenge_tbl.find(order_id);
+    eosio_assert(challenge_iter != challenge_tbl.end(), "can't find challenge");
+    eosio_assert(is_challenge_end(get_challenge_state(order_id)), "invalid challenge state, cannot resize");
+
+    auto order_info = *order_iter;
+    update_order(order_info, *challenge_iter, sender);
+    eosio_assert(order_info.state == OrderStateWaiting || order_info.state == OrderStateDeliver, "order state is invalid, can't resize");
+    extended_asset new_pledge = order_info.miner_pledge + delta_pst;
+    eosio_assert(new_pledge.amount > 0, "order must keep a positive amount");
+
+    account_name miner = order_info.miner;
+    migrate_bills(miner);
+    bill_stats sst(_self, miner);
+    auto ust = sst.find(order_info.bill_id);
+    extended_asset new_price = extended_asset(0, dmc_sym);
+    if (ust != sst.end()) {
+        eosio_assert(ust->unmatched >= delta_pst.amount, "overdrawn balance");
+        uint64_t bill_dmc_claims_interval = get_dmc_config(name { N(billinter) }, default_bill_dmc_claims_interval);
+        eosio_assert(delta_pst.amount < 0 || ust->created_at + bill_dmc_claims_interval > time_point_sec(now()), "bill expired");
+
+        double price = (double)ust->price / std::pow(2, 32);
+        new_price = get_asset_by_amount<double, std::ceil>(price * new_pledge.amount, dmc_sym);
+        uint64_t now_time_t = calbonus(miner, order_info.bill_id, sender);
+        sst.modify(ust, 0, [&](auto& s) {
+            s.unmatched -= delta_pst.amount;
+            s.matched += delta_pst.amount;
+            s.updated_at = time_point_sec(now_time_t);
+        });
+        change_bill_stats(miner, -delta_pst.amount, delta_pst.amount);
+    } else {
+        // 挂单已撤销或到期清理时只能缩容：价格按原订单比例折算，释放的 PST 与撤单一样退回矿工
+        eosio_assert(delta_pst.amount < 0, "no such record");
+        new_price.amount = int64_t((uint128_t(order_info.price.amount) * new_pledge.amount + order_info.miner_pledge.amount - 1) / order_info.miner_pledge.amount);
+        add_balance(miner, -delta_pst, sender);
+    }
+
+    // 交付中的订单：已过时间按原价格结算，未使用部分退回预存额，新价格从现在起锁定一个完整周期
+    extended_asset elapsed = extended_asset(0, dmc_sym);
+    if (order_info.state == OrderStateDeliver) {
+        uint64_t claims_interval = get_dmc_config(name { N(claiminter) }, default_dmc_claims_interval);
+        uint64_t elapsed_time = now() - order_info.latest_settlement_date.sec_since_epoch();
+        elapsed_time = std::min(elapsed_time, claims_interval);
+        elapsed.amount = (int64_t)((uint128_t)order_info.price.amount * elapsed_time / claims_interval);
+        order_info.latest_settlement_date = time_point_sec(now());
+    }
+    extended_asset refund = order_info.lock_pledge - elapsed;
+    eosio_assert(order_info.user_pledge + refund >= new_price, "not enough dmc to resize");
+    order_info.user_pledge += refund - new_price;
+    order_info.settlement_pledge += elapsed;
+    order_info.lock_pledge = new_price;
+    SEND_INLINE_ACTION(*this, ordercharec, { _self, N(active) },
+        { order_id, refund - new_price, new_price - refund - elapsed, elapsed, extended_asset(0, dmc_sym), time_point_sec(now()), OrderReceiptUpdate });
+
+    // 已结算部分按调整前的容量发放奖励
+    auto challenge = *challenge_iter;
+    if (order_info.settlement_pledge.amount > 0) {
+        claim_dmc_reward(order_info, challenge, sender);
+        order_info.settlement_pledge = extended_asset(0, order_info.settlement_pledge.get_extended_symbol());
+    }
+    order_info.miner_pledge = new_pledge;
+    order_info.price = new_price;
+
+    change_order_stats(*order_iter, order_info);
+    order_tbl.modify(order_iter, sender, [&](auto& o) {
+        o = order_info;
+    });
+    challenge_tbl.modify(challenge_iter, sender, [&](auto& c) {
+        c.miner_pay = challenge.miner_pay;
+    });
+}
+
+void token::setautopay(name sender, uint64_t order_id, extended_asset cap)
+{
+    require_auth(sender);
+    eosio_assert(cap.get_extended_symbol() == dmc_sym, "only DMC can be used to pay orders");
+    eosio_assert(cap.amount >= 0, "cap must be non-negative");
+    dmc_orders order_tbl(_self, _self);
+    auto order_iter = order_tbl.find(order_id);
+    eosio_assert(order_iter != order_tbl.end(), "can't find order");
+    eosio_assert(order_iter->user == sender, "only user can set order autopay");
+
+    if (cap.amount == 0) {
+        remove_order_autopay(order_id);
+        return;
+    }
+
+    order_autopays autopay_tbl(_self, _self);
+    auto autopay_iter = autopay_tbl.find(order_id);
+
+    eosio_assert(order_iter->state != OrderStateEnd, "order is already end");
+    if (autopay_iter == autopay_tbl.end()) {
+        autopay_tbl.emplace(sender, [&](auto& a) {
+            a.order_id = order_id;
+            a.user = sender;
+            a.remaining = cap;
+        });
+    } else {
+        autopay_tbl.modify(autopay_iter, sender, [&](auto& a) {
+            a.remaining = cap;
+        });
+    }
+}
+
 void token::ordermig(account_name payer, uint32_t limit)
 {
     require_auth(payer);
@@ -280,6 +448,7 @@ void token::ordermig(account_name payer, uint32_t limit)
                 c.miner_pay = extended_asset(0, dmc_sym);
             });
         }
+        change_order_stats(*order_iter, order_info);
         order_tbl.modify(order_iter, payer, [&](auto& c) {
             c = order_info;
         });
@@ -287,4 +456,156 @@ void token::ordermig(account_name payer, uint32_t limit)
     set_order_migration(order_info.order_id, payer);
 }
 
+void token::statsmig(account_name payer, uint32_t limit)
+{
+    require_auth(payer);
+    stats_migration_table mig_tbl(_self, _self);
+    auto mig_iter = mig_tbl.begin();
+    if (mig_iter == mig_tbl.end()) {
+        mig_iter = mig_tbl.emplace(payer, [&](auto& m) {
+            m.current_id = 0;
+            m.finished = false;
+        });
+    }
+    if (mig_iter->finished) {
+        return;
+    }
+
+    dmc_orders order_tbl(_self, _self);
+    dmc_challenges challenge_tbl(_self, _self);
+    uint64_t current_id = mig_iter->current_id;
+    auto order_iter = order_tbl.upper_bound(current_id);
+    for (size_t i = 0; (order_iter != order_tbl.end()) && (i < limit); order_iter++, i++) {
+        dmc_aggregate delta = get_order_aggregate(*order_iter);
+        auto challenge_iter = challenge_tbl.find(order_iter->order_id);
+        if (challenge_iter != challenge_tbl.end()) {
+            delta.open_challenges = challenge_iter->state == ChallengeRequest ? 1 : 0;
+            delta.total_challenges = challenge_iter->challenge_times;
+        }
+        change_dmc_stats(order_iter->miner, delta);
+        if (is_sample_eligible(order_iter->state))
+            add_sample_index(order_iter->order_id);
+        current_id = order_iter->order_id;
+    }
+
+    bool finished = order_iter == order_tbl.end();
+    mig_tbl.modify(mig_iter, payer, [&](auto& m) {
+        m.current_id = current_id;
+        m.finished = finished;
+    });
+    if (!finished)
+        return;
+
+    market_stats market_tbl(_self, _self);
+    auto market_iter = market_tbl.find(0);
+    if (market_iter == market_tbl.end()) {
+        market_tbl.emplace(payer, [&](auto& s) {
+            s.miner = 0;
+            s.incomplete = false;
+        });
+    } else {
+        market_tbl.modify(market_iter, 0, [&](auto& s) {
+            s.incomplete = false;
+        });
+    }
+}
+
+// 同时累加到矿工记录与全局汇总
+void token::change_dmc_stats(account_name miner, const dmc_aggregate& delta)
+{
+    auto apply = [&](auto& s) {
+        s.bill_pst += delta.bill_pst;
+        s.matched_pst += delta.matched_pst;
+        s.active_orders += delta.active_orders;
+        s.pledged_dmc += delta.pledged_dmc;
+        s.open_challenges += delta.open_challenges;
+        s.total_challenges += delta.total_challenges;
+    };
+
+    miner_stats miner_tbl(_self, _self);
+    auto miner_iter = miner_tbl.find(miner);
+    if (miner_iter == miner_tbl.end()) {
+        miner_tbl.emplace(_self, [&](auto& s) {
+            s.miner = miner;
+            apply(s);
+        });
+    } else {
+        miner_tbl.modify(miner_iter, 0, apply);
+    }
+
+    market_stats market_tbl(_self, _self);
+    auto market_iter = market_tbl.find(0);
+    if (market_iter == market_tbl.end()) {
+        market_tbl.emplace(_self, [&](auto& s) {
+            s.miner = 0;
+            s.incomplete = true;
+            apply(s);
+        });
+    } else {
+        market_tbl.modify(market_iter, 0, apply);
+    }
+}
+
+void token::change_bill_stats(account_name miner, int64_t unmatched, int64_t matched)
+{
+    if (unmatched == 0 && matched == 0)
+        return;
+
+    dmc_aggregate delta;
+    delta.bill_pst = unmatched;
+    delta.matched_pst = matched;
+    change_dmc_stats(miner, delta);
+}
+
+// statsmig 扫描之前的订单不按增量维护，扫描时按当时状态一次计入
+bool token::is_stats_tracked(uint64_t order_id)
+{
+    stats_migration_table mig_tbl(_self, _self);
+    auto mig_iter = mig_tbl.begin();
+    return mig_iter != mig_tbl.end() && (mig_iter->finished || order_id <= mig_iter->current_id);
+}
+
+token::dmc_aggregate token::get_order_aggregate(const dmc_order& order)
+{
+    dmc_aggregate aggregate;
+    aggregate.active_orders = (order.state == OrderStateEnd || order.state == OrderStateAbort) ? 0 : 1;
+    aggregate.pledged_dmc = (order.user_pledge + order.lock_pledge + order.settlement_pledge).amount;
+    return aggregate;
+}
+
+void token::change_order_stats(const dmc_order& before, const dmc_order& after)
+{
+    if (!is_stats_tracked(after.order_id))
+        return;
+
+    // 抽查索引与统计共用 statsmig 的进度，扫描前的订单由 statsmig 一次加入
+    bool was_eligible = is_sample_eligible(before.state);
+    bool is_eligible = is_sample_eligible(after.state);
+    if (!was_eligible && is_eligible)
+        add_sample_index(after.order_id);
+    else if (was_eligible && !is_eligible)
+        remove_sample_index(after.order_id);
+
+    dmc_aggregate delta = get_order_aggregate(after);
+    dmc_aggregate origin = get_order_aggregate(before);
+    delta.active_orders -= origin.active_orders;
+    delta.pledged_dmc -= origin.pledged_dmc;
+    if (delta.active_orders == 0 && delta.pledged_dmc == 0)
+        return;
+    change_dmc_stats(after.miner, delta);
+}
+
+void token::change_challenge_stats(const dmc_order& order, ChallengeState before, ChallengeState after)
+{
+    if (before == after || !is_stats_tracked(order.order_id))
+        return;
+
+    dmc_aggregate delta;
+    delta.open_challenges = (after == ChallengeRequest ? 1 : 0) - (before == ChallengeRequest ? 1 : 0);
+    delta.total_challenges = after == ChallengeRequest ? 1 : 0;
+    if (delta.open_challenges == 0)
+        return;
+    change_dmc_stats(order.miner, delta);
+}
+
 }
@@ -25,31 +25,34 @@ EOSIO_ABI(eosio::token,
     // classic tokens
     (create)(issue)(transfer)(close)(retire)
     // smart tokens
-    (excreate)(exissue)(extransfer)(exclose)(exretire)(exdestroy)
+    (excreate)(exissue)(extransfer)(exclose)(closezero)(exretire)(exdestroy)
     //
-    (exchange)
+    (setnotify)
     //
-    (exunlock)(exlock)(exlocktrans)
+    (exchange)(exchangepath)(exchangebatch)
+    //
+    (exunlock)(exlock)(exlocktrans)(exvest)(exunvest)(lockmig)
     //
     (receipt)(outreceipt)(traderecord)(orderchange)(bidrec)(uniswapsnap)
     //
-    (addreserves)(outreserves)
+    (addreserves)(addreservez)(outreserves)(swapmig)(lpmig)
     //
-    (bill)(unbill)(getincentive)(setabostats)(allocation)(order)
+    (bill)(unbill)(getincentive)(claimallinc)(expirebills)(billmig)(delreqkey)(setabostats)(allocation)(order)
     //
     (billrec)(orderrec)(incentiverec)(orderclarec)
     //
-    (increase)(redemption)(mint)(setmakerrate)
+    (increase)(redemption)(claimunbond)(mint)(setmakerrate)(makermig)
     //
-    (addmerkle)(reqchallenge)(anschallenge)(arbitration)(paychallenge)
+    (addmerkle)(reqchallenge)(anschallenge)(arbitration)(paychallenge)(sweepchall)
+    (samplechall)(anssamples)(sweepsample)
     //
     (liquidation)(liqrec)(makerliqrec)
     //
     (setdmcconfig)
     //
-    (claimorder)(addordasset)(subordasset)(updateorder)
+    (claimorder)(addordasset)(subordasset)(setautopay)(resizeorder)(updateorder)
     //
-    (makercharec)(ordercharec)(assetcharec)(ordermig)
+    (makercharec)(ordercharec)(assetcharec)(allocrec)(ordermig)(statsmig)
     //
     (nftcreatesym)(nftcreate)(nftissue)(nfttransfer)(nfttransferb)(nftburn)(burnbatch)
     //
@@ -19,6 +19,7 @@ void token::exlock(account_name owner, extended_asset quantity, time_point_sec e
 
     extended_symbol quantity_sym = quantity.get_extended_symbol();
     eosio_assert(quantity_sym != pst_sym && quantity_sym != rsi_sym, "pst and rsi are not allowed to be locked");
+    eosio_assert(!is_lp_symbol(quantity_sym), "lp tokens are not allowed to be locked");
 
     stats statstable(_self, quantity.contract);
     const auto& st = statstable.get(quantity.get_extended_symbol().name(), "token with symbol does not exist");
@@ -42,8 +43,8 @@ void token::exlocktrans(account_name from, account_name to, extended_asset quant
 
     eosio_assert(is_account(to), "cannot transfer lock tokens to nonexist account");
 
-    require_recipient(from);
-    require_recipient(to);
+    notify_recipient(from);
+    notify_recipient(to);
 
     eosio_assert(quantity.is_valid(), "invalid quantity when transfer lock tokens");
     eosio_assert(quantity.amount > 0, "must transfer lock tokens in positive quantity");
@@ -51,6 +52,7 @@ void token::exlocktrans(account_name from, account_name to, extended_asset quant
 
     extended_symbol quantity_sym = quantity.get_extended_symbol();
     eosio_assert(quantity_sym != pst_sym && quantity_sym != rsi_sym, "pst and rsi are not allowed to be locked");
+    eosio_assert(!is_lp_symbol(quantity_sym), "lp tokens are not allowed to be locked");
 
     if (time_point_sec(now()) < expiration) {
         eosio_assert(expiration_to >= expiration, "expiration_to must longer than expiration");
@@ -89,39 +91,199 @@ void token::exunlock(account_name owner, extended_asset quantity, time_point_sec
     });
 }
 
+void token::exvest(account_name from, account_name to, extended_asset quantity, time_point_sec start_at, time_point_sec cliff_at, time_point_sec end_at, string memo)
+{
+    require_auth(from);
+
+    eosio_assert(is_account(to), "to account does not exist");
+    eosio_assert(quantity.is_valid(), "invalid quantity");
+    eosio_assert(quantity.amount > 0, "must vest positive amount");
+    eosio_assert(memo.size() <= 256, "memo has more than 256 bytes");
+    eosio_assert(start_at < end_at, "start_at must be earlier than end_at");
+    eosio_assert(start_at <= cliff_at && cliff_at <= end_at, "cliff_at must be between start_at and end_at");
+
+    extended_symbol quantity_sym = quantity.get_extended_symbol();
+    eosio_assert(quantity_sym != pst_sym && quantity_sym != rsi_sym, "pst and rsi are not allowed to be locked");
+    eosio_assert(!is_lp_symbol(quantity_sym), "lp tokens are not allowed to be locked");
+
+    notify_recipient(from);
+    notify_recipient(to);
+
+    stats statstable(_self, quantity.contract);
+    const auto& st = statstable.get(quantity.get_extended_symbol().name(), "token with symbol does not exist");
+
+    sub_balance(from, quantity);
+
+    vestings vest_tbl(_self, to);
+    vest_tbl.emplace(from, [&](auto& v) {
+        v.primary = vest_tbl.available_primary_key();
+        v.total = quantity;
+        v.released = extended_asset(0, quantity_sym);
+        v.start_at = start_at;
+        v.cliff_at = cliff_at;
+        v.end_at = end_at;
+    });
+
+    statstable.modify(st, 0, [&](auto& s) {
+        if (s.reserve_supply.symbol != s.supply.symbol)
+            s.reserve_supply = quantity;
+        else
+            s.reserve_supply += quantity;
+        s.supply -= quantity;
+    });
+}
+
+void token::exunvest(account_name owner, uint64_t primary, string memo)
+{
+    require_auth(owner);
+    eosio_assert(memo.size() <= 256, "memo has more than 256 bytes");
+
+    vestings vest_tbl(_self, owner);
+    const auto& v = vest_tbl.get(primary, "no such vesting schedule");
+
+    extended_asset quantity = get_vested(v, time_point_sec(now())) - v.released;
+    eosio_assert(quantity.amount > 0, "nothing to unvest");
+
+    stats statstable(_self, quantity.contract);
+    const auto& st = statstable.get(quantity.get_extended_symbol().name(), "token with symbol does not exist");
+
+    add_balance(owner, quantity, owner);
+
+    statstable.modify(st, 0, [&](auto& s) {
+        s.reserve_supply -= quantity;
+        s.supply += quantity;
+    });
+
+    if (v.released + quantity == v.total) {
+        vest_tbl.erase(v);
+    } else {
+        vest_tbl.modify(v, 0, [&](auto& s) {
+            s.released += quantity;
+        });
+    }
+}
+
+extended_asset token::get_vested(const vesting_schedule& schedule, time_point_sec now_time)
+{
+    if (now_time < schedule.cliff_at)
+        return extended_asset(0, schedule.total.get_extended_symbol());
+    if (now_time >= schedule.end_at)
+        return schedule.total;
+
+    uint64_t elapsed = now_time.sec_since_epoch() - schedule.start_at.sec_since_epoch();
+    uint64_t duration = schedule.end_at.sec_since_epoch() - schedule.start_at.sec_since_epoch();
+    uint128_t vested = uint128_t(schedule.total.amount) * elapsed / duration;
+    return extended_asset(int64_t(vested), schedule.total.get_extended_symbol());
+}
+
+void token::lockmig(account_name owner, uint32_t limit)
+{
+    require_auth(owner);
+    eosio_assert(limit > 0, "limit must be positive");
+    migrate_lock_accounts(owner, limit, owner);
+}
+
+uint64_t token::find_lock_bucket(account_name owner, extended_symbol sym)
+{
+    lock_buckets buckets(_self, owner);
+    auto bucket_index = buckets.get_index<N(bysymbol)>();
+    auto it = bucket_index.find(account::key(sym));
+    return it != bucket_index.end() ? it->id : 0;
+}
+
+// 分组内已没有锁仓记录时删除分组
+void token::erase_empty_lock_bucket(account_name owner, uint64_t bucket_id)
+{
+    lock_balances lock_tbl(_self, bucket_id);
+    if (lock_tbl.begin() != lock_tbl.end())
+        return;
+    lock_buckets buckets(_self, owner);
+    buckets.erase(buckets.get(bucket_id));
+}
+
+// 迁移 owner 在 lock_timestamp 到期的单条旧记录
+void token::migrate_lock_account(account_name owner, extended_symbol sym, time_point_sec lock_timestamp, account_name ram_payer)
+{
+    legacy_lock_accounts legacy_acnts(_self, owner);
+    auto legacy_index = legacy_acnts.get_index<N(byextendedasset)>();
+    auto it = legacy_index.find(legacy_lock_account::key(sym, lock_timestamp));
+    if (it == legacy_index.end())
+        return;
+    // 旧记录的 RAM 退还原付费账户
+    lock_add_balance(owner, it->balance, it->lock_timestamp, ram_payer);
+    legacy_index.erase(it);
+}
+
+// 按到期顺序遍历前需迁移该通证的全部旧记录，单次最多迁移 lock_migration_limit 条
+void token::migrate_lock_symbol(account_name owner, extended_symbol sym, account_name ram_payer)
+{
+    legacy_lock_accounts legacy_acnts(_self, owner);
+    auto legacy_index = legacy_acnts.get_index<N(byextendedasset)>();
+    auto it = legacy_index.lower_bound(legacy_lock_account::key(sym, time_point_sec()));
+    for (uint64_t i = 0; i < lock_migration_limit && it != legacy_index.end() && it->balance.get_extended_symbol() == sym; i++) {
+        lock_add_balance(owner, it->balance, it->lock_timestamp, ram_payer);
+        it = legacy_index.erase(it);
+    }
+    eosio_assert(it == legacy_index.end() || it->balance.get_extended_symbol() != sym, "too many legacy lock records, call lockmig first");
+}
+
+void token::migrate_lock_accounts(account_name owner, uint64_t limit, account_name ram_payer)
+{
+    legacy_lock_accounts legacy_acnts(_self, owner);
+    auto it = legacy_acnts.begin();
+    for (uint64_t i = 0; it != legacy_acnts.end() && i < limit; i++) {
+        lock_add_balance(owner, it->balance, it->lock_timestamp, ram_payer);
+        it = legacy_acnts.erase(it);
+    }
+}
+
 void token::lock_sub_balance(account_name owner, extended_asset value, time_point_sec expiration)
 {
-    lock_accounts from_acnts(_self, owner);
-    auto from_iter = from_acnts.get_index<N(byextendedasset)>();
-    auto from = from_iter.find(lock_account::key(value.get_extended_symbol(), expiration));
+    extended_symbol sym = value.get_extended_symbol();
+    migrate_lock_account(owner, sym, expiration, owner);
+
+    uint64_t bucket_id = find_lock_bucket(owner, sym);
+    eosio_assert(bucket_id != 0, "no such lock tokens");
+    lock_balances from_acnts(_self, bucket_id);
+    auto from = from_acnts.find(expiration.sec_since_epoch());
 
-    eosio_assert(from != from_iter.end(), "no such lock tokens");
+    eosio_assert(from != from_acnts.end(), "no such lock tokens");
+    eosio_assert(from->balance.get_extended_symbol() == sym, "symbol precision mismatch");
     eosio_assert(from->balance.amount >= value.amount, "overdrawn balance when sub lock balance");
-    eosio_assert(from->balance.symbol == value.symbol, "symbol precision mismatch");
 
     if (from->balance.amount == value.amount) {
-        from_iter.erase(from);
+        from_acnts.erase(from);
+        erase_empty_lock_bucket(owner, bucket_id);
     } else {
-        from_iter.modify(from, 0, [&](auto& a) {
+        from_acnts.modify(from, 0, [&](auto& a) {
             a.balance -= value;
         });
     }
 }
 
+// 旧记录不在此迁移，同一到期时间的旧记录迁移时会合并到新记录中
 void token::lock_add_balance(account_name owner, extended_asset value, time_point_sec expiration, account_name ram_payer)
 {
-    lock_accounts to_acnts(_self, owner);
-    auto to_iter = to_acnts.get_index<N(byextendedasset)>();
-    auto to = to_iter.find(lock_account::key(value.get_extended_symbol(), expiration));
+    extended_symbol sym = value.get_extended_symbol();
+    uint64_t bucket_id = find_lock_bucket(owner, sym);
+    if (bucket_id == 0) {
+        bucket_id = next_id(N(lockbucket));
+        lock_buckets buckets(_self, owner);
+        buckets.emplace(ram_payer, [&](auto& b) {
+            b.id = bucket_id;
+            b.symbol = sym;
+        });
+    }
 
-    if (to == to_iter.end()) {
+    lock_balances to_acnts(_self, bucket_id);
+    auto to = to_acnts.find(expiration.sec_since_epoch());
+    if (to == to_acnts.end()) {
         to_acnts.emplace(ram_payer, [&](auto& a) {
-            a.primary = to_acnts.available_primary_key();
             a.balance = value;
             a.lock_timestamp = expiration;
         });
     } else {
-        to_iter.modify(to, 0, [&](auto& a) {
+        to_acnts.modify(to, 0, [&](auto& a) {
             a.balance += value;
         });
     }
@@ -129,27 +291,117 @@ void token::lock_add_balance(account_name owner, extended_asset value, time_poin
 
 void token::lock_sub_balance(account_name foundation, extended_asset quantity, bool recur)
 {
-    lock_accounts from_acnts(_self, foundation);
+    extended_symbol quantity_sym = quantity.get_extended_symbol();
+    migrate_lock_symbol(foundation, quantity_sym, foundation);
 
-    auto from_iter = from_acnts.get_index<N(byextendedasset)>();
-    auto from = from_iter.lower_bound(lock_account::key(quantity.get_extended_symbol(), time_point_sec()));
+    uint64_t bucket_id = find_lock_bucket(foundation, quantity_sym);
+    eosio_assert(bucket_id != 0, "overdrawn balance when lock_sub");
+    lock_balances from_acnts(_self, bucket_id);
+    auto from = from_acnts.begin();
 
-    eosio_assert(quantity.get_extended_symbol() == from->balance.get_extended_symbol(), "symbol precision mismatch");
-    while (quantity.amount > 0) {
-        eosio_assert(from != from_iter.end(), "overdrawn balance when lock_sub");
+    // 单次最多处理 lock_walk_limit 条记录，超出时需分多次转出
+    for (uint64_t i = 0; quantity.amount > 0; i++) {
+        eosio_assert(from != from_acnts.end(), "overdrawn balance when lock_sub");
+        eosio_assert(i < lock_walk_limit, "too many lock records in one call, split the quantity");
 
         if (recur)
             eosio_assert(time_point_sec(now()) >= from->lock_timestamp, "under expiration time");
 
         quantity -= from->balance;
         if (quantity.amount >= 0) {
-            from = from_iter.erase(from);
+            from = from_acnts.erase(from);
         } else {
-            from_iter.modify(from, 0, [&](auto& a) {
+            from_acnts.modify(from, 0, [&](auto& a) {
                 a.balance.amount = std::abs(quantity.amount);
             });
         }
     }
+    erase_empty_lock_bucket(foundation, bucket_id);
+}
+
+void token::unlock_matured(account_name owner, extended_asset value, account_name ram_payer)
+{
+    extended_asset balance = get_balance(value, owner);
+    if (balance >= value)
+        return;
+
+    extended_symbol sym = value.get_extended_symbol();
+    migrate_lock_symbol(owner, sym, ram_payer);
+
+    auto now_time = time_point_sec(now());
+    extended_asset shortfall = value - balance;
+    extended_asset unlocked = extended_asset(0, sym);
+    uint64_t bucket_id = find_lock_bucket(owner, sym);
+    if (bucket_id != 0) {
+        lock_balances lock_acnts(_self, bucket_id);
+        auto it = lock_acnts.begin();
+        while (unlocked < shortfall && it != lock_acnts.end() && it->lock_timestamp <= now_time) {
+            extended_asset needed = shortfall - unlocked;
+            if (it->balance <= needed) {
+                unlocked += it->balance;
+                it = lock_acnts.erase(it);
+            } else {
+                lock_acnts.modify(it, 0, [&](auto& a) {
+                    a.balance -= needed;
+                });
+                unlocked += needed;
+            }
+        }
+        erase_empty_lock_bucket(owner, bucket_id);
+    }
+
+    // 赎回的 DMC 未计入 reserve_supply，直接入账
+    extended_asset released = extended_asset(0, sym);
+    if (sym == dmc_sym && unlocked < shortfall)
+        released = release_unbonding(owner, (shortfall - unlocked).amount);
+
+    if (unlocked.amount + released.amount == 0)
+        return;
+
+    add_balance(owner, unlocked + released, ram_payer);
+    if (unlocked.amount == 0)
+        return;
+
+    stats statstable(_self, sym.contract);
+    const auto& st = statstable.get(sym.name(), "token with symbol does not exist");
+    statstable.modify(st, 0, [&](auto& s) {
+        s.reserve_supply -= unlocked;
+        s.supply += unlocked;
+    });
+}
+
+// 已到期可由 unlock_matured 解锁的数量，只读取不修改
+extended_asset token::get_matured_balance(account_name owner, extended_symbol sym)
+{
+    auto now_time = time_point_sec(now());
+    extended_asset matured = extended_asset(0, sym);
+
+    uint64_t bucket_id = find_lock_bucket(owner, sym);
+    if (bucket_id != 0) {
+        lock_balances lock_acnts(_self, bucket_id);
+        for (auto it = lock_acnts.begin(); it != lock_acnts.end() && it->lock_timestamp <= now_time; it++)
+            matured += it->balance;
+    }
+
+    legacy_lock_accounts legacy_acnts(_self, owner);
+    auto legacy_index = legacy_acnts.get_index<N(byextendedasset)>();
+    for (auto it = legacy_index.lower_bound(legacy_lock_account::key(sym, time_point_sec()));
+         it != legacy_index.end() && it->balance.get_extended_symbol() == sym && it->lock_timestamp <= now_time; it++)
+        matured += it->balance;
+
+    if (sym == dmc_sym) {
+        unbond_queue queue(_self, owner);
+        for (auto it = queue.begin(); it != queue.end() && it->release_at <= now_time; it++)
+            matured += it->quantity;
+    }
+    return matured;
+}
+
+bool token::has_balance_record(account_name owner, extended_symbol sym)
+{
+    accounts acnts(_self, owner);
+    auto acnts_index = acnts.get_index<N(byextendedasset)>();
+    return acnts_index.find(account::key(sym)) != acnts_index.end();
 }
 
 extended_asset token::get_balance(extended_asset quantity, account_name name)
@@ -107,4 +107,9 @@ void token::assetcharec(account_name owner, extended_asset changed, uint8_t type
 {
     require_auth(_self);
 }
+
+void token::allocrec(account_name owner, extended_asset quantity, string memo)
+{
+    require_auth(_self);
+}
 } /// namespace eosio
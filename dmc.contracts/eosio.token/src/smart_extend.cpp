@@ -23,16 +23,23 @@ void token::exdestroy(extended_symbol sym)
     }
 
     if (st.reserve_supply.amount > 0) {
-        lock_accounts from_acnts(_self, sym.contract);
-
         uint64_t balances = 0;
-        for (auto it = from_acnts.begin(); it != from_acnts.end();) {
-            if (it->balance.get_extended_symbol() == sym) {
+        uint64_t bucket_id = find_lock_bucket(sym.contract, sym);
+        if (bucket_id != 0) {
+            lock_balances from_acnts(_self, bucket_id);
+            for (auto it = from_acnts.begin(); it != from_acnts.end();) {
                 balances += it->balance.amount;
                 it = from_acnts.erase(it);
-            } else {
-                it++;
             }
+            erase_empty_lock_bucket(sym.contract, bucket_id);
+        }
+
+        legacy_lock_accounts legacy_acnts(_self, sym.contract);
+        auto legacy_index = legacy_acnts.get_index<N(byextendedasset)>();
+        for (auto it = legacy_index.lower_bound(legacy_lock_account::key(sym, time_point_sec()));
+             it != legacy_index.end() && it->balance.get_extended_symbol() == sym;) {
+            balances += it->balance.amount;
+            it = legacy_index.erase(it);
         }
 
         eosio_assert(st.reserve_supply.amount == balances, "reserve_supply must all in issuer");
@@ -46,11 +53,53 @@ void token::exchange(account_name owner, extended_asset quantity, extended_asset
     require_auth(owner);
     eosio_assert(quantity.is_valid() && to.is_valid(), "invalid exchange currency");
     eosio_assert(memo.size() <= 256, "memo has more than 256 bytes");
-    price = 0;
     auto from_sym = quantity.get_extended_symbol();
     auto to_sym = to.get_extended_symbol();
 
-    uniswaporder(owner, quantity, to, price, id, owner);
+    uniswaporder(owner, quantity, to, id, owner);
+}
+
+void token::exchangepath(account_name owner, extended_asset quantity, std::vector<extended_symbol> path, extended_asset min_out)
+{
+    require_auth(owner);
+    eosio_assert(quantity.is_valid() && min_out.is_valid(), "invalid exchange currency");
+    eosio_assert(quantity.amount > 0, "must exchange positive amount");
+    eosio_assert(!path.empty() && path.size() <= 5, "exchange path must have 1 to 5 hops");
+    eosio_assert(path.back() == min_out.get_extended_symbol(), "min_out symbol mismatch");
+
+    extended_asset current = quantity;
+    for (const auto& sym : path) {
+        eosio_assert(sym != current.get_extended_symbol(), "invalid exchange path");
+        extended_asset out = extended_asset(0, sym);
+        uniswaptrade(owner, current, out, owner);
+        current = out;
+    }
+    eosio_assert(current >= min_out, "exchange output is less than min_out");
+
+    sub_balance(owner, quantity);
+    add_balance(owner, current, owner);
+
+    SEND_INLINE_ACTION(*this, uniswapsnap, { _self, N(active) },
+        { owner, current });
+}
+
+void token::exchangebatch(std::vector<exchange_args> orders)
+{
+    eosio_assert(!orders.empty() && orders.size() <= 100, "exchange batch must have 1 to 100 orders");
+
+    std::map<uint64_t, std::vector<exchange_args>> pools;
+    for (const auto& o : orders) {
+        require_auth(o.owner);
+        eosio_assert(o.quantity.is_valid() && o.min_out.is_valid(), "invalid exchange currency");
+        eosio_assert(o.quantity.amount > 0 && o.min_out.amount >= 0, "must exchange positive amount");
+        auto from_sym = o.quantity.get_extended_symbol();
+        auto to_sym = o.min_out.get_extended_symbol();
+        eosio_assert(from_sym != to_sym, "can't exchange same token");
+        pools[uniswap_market::pair_key(from_sym, to_sym)].push_back(o);
+    }
+
+    for (const auto& p : pools)
+        uniswapbatch(p.second);
 }
 
 } /// namespace eosio
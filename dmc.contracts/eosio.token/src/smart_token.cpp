@@ -27,7 +27,8 @@ void token::excreate(account_name issuer, asset maximum_supply, asset reserve_su
 
     eosio_assert(reserve_supply.amount <= maximum_supply.amount, "invalid reserve_supply amount");
     eosio_assert(reserve_supply.amount >= 0, "reserve_supply must be positive");
-    lock_add_balance(get_foundation(issuer), extended_asset(reserve_supply, issuer), expiration, issuer);
+    if (reserve_supply.amount > 0)
+        lock_add_balance(get_foundation(issuer), extended_asset(reserve_supply, issuer), expiration, issuer);
 
     statstable.emplace(issuer, [&](auto& s) {
         s.issuer = issuer;
@@ -53,14 +54,16 @@ void token::exissue(account_name to, extended_asset quantity, string memo)
 
     add_stats(quantity);
 
-    add_balance(foundation, quantity, foundation);
+    // credit the receiver directly instead of bouncing through foundation with an inline extransfer
+    add_balance(to, quantity, foundation);
 
-    if (to != foundation) {
-        SEND_INLINE_ACTION(*this, extransfer, { foundation, N(active) }, { foundation, to, quantity, memo });
-    }
+    if (to != foundation)
+        notify_recipient(to);
 
-    if (quantity.get_extended_symbol() == pst_sym)
+    if (quantity.get_extended_symbol() == pst_sym) {
         change_pst(to, quantity);
+        change_maker_pst(to, quantity.amount);
+    }
 }
 
 void token::extransfer(account_name from, account_name to, extended_asset quantity, string memo)
@@ -80,8 +83,8 @@ void token::extransfer(account_name from, account_name to, extended_asset quanti
 
     eosio_assert(is_account(to), "to account does not exist");
 
-    require_recipient(from);
-    require_recipient(to);
+    notify_recipient(from);
+    notify_recipient(to);
 
     eosio_assert(quantity.is_valid(), "invalid currency");
     eosio_assert(quantity.amount > 0, "must transfer positive amount");
@@ -91,6 +94,7 @@ void token::extransfer(account_name from, account_name to, extended_asset quanti
     // producer pay
     auto payer = has_auth(to) ? to : from;
 
+    unlock_matured(from, quantity, from);
     sub_balance(from, quantity);
     add_balance(to, quantity, payer);
 }
@@ -112,13 +116,7 @@ void token::exretire(account_name from, extended_asset quantity, string memo)
 
     if (quantity.get_extended_symbol() == pst_sym) {
         change_pst(from, -quantity);
-        dmc_makers maker_tbl(_self, _self);
-        auto iter = maker_tbl.find(from);
-        if (iter != maker_tbl.end()) {
-            maker_tbl.modify(iter, 0, [&](auto& m) {
-                m.current_rate = cal_current_rate(iter->total_staked, from);
-            });
-        }
+        change_maker_pst(from, -quantity.amount);
     }
 }
 
@@ -132,6 +130,58 @@ void token::exclose(account_name owner, extended_symbol symbol)
     it_iter.erase(it);
 }
 
+void token::closezero(account_name owner, uint32_t limit)
+{
+    if (!has_auth(_self))
+        require_auth(owner);
+    eosio_assert(limit > 0, "limit must be positive");
+
+    accounts acnts(_self, owner);
+    uint32_t scanned = 0;
+    for (auto it = acnts.begin(); it != acnts.end() && scanned < limit; scanned++) {
+        if (it->balance.amount == 0)
+            it = acnts.erase(it);
+        else
+            it++;
+    }
+}
+
+void token::setnotify(account_name owner, bool notify)
+{
+    require_auth(owner);
+
+    notify_optouts optouts(_self, _self);
+    auto it = optouts.find(owner);
+    if (notify) {
+        eosio_assert(it != optouts.end(), "notification already enabled");
+        optouts.erase(it);
+    } else {
+        eosio_assert(it == optouts.end(), "notification already disabled");
+        optouts.emplace(owner, [&](auto& o) {
+            o.owner = owner;
+        });
+    }
+    notify_cache[owner] = notify;
+}
+
+void token::notify_recipient(account_name owner)
+{
+    auto cached = notify_cache.find(owner);
+    if (cached == notify_cache.end()) {
+        notify_optouts optouts(_self, _self);
+        cached = notify_cache.emplace(owner, optouts.find(owner) == optouts.end()).first;
+    }
+    if (cached->second)
+        require_recipient(owner);
+}
+
+bool token::is_closezero_enabled()
+{
+    if (closezero_cache < 0)
+        closezero_cache = get_dmc_config(name { N(closezero) }, 0) != 0 ? 1 : 0;
+    return closezero_cache != 0;
+}
+
 void token::sub_balance(account_name owner, extended_asset value)
 {
     accounts from_acnts(_self, owner);
@@ -143,9 +193,13 @@ void token::sub_balance(account_name owner, extended_asset value)
     eosio_assert(from->balance.amount >= value.amount, "overdrawn balance when sub balance");
     eosio_assert(from->balance.symbol == value.symbol, "symbol precision mismatch");
 
-    from_iter.modify(from, 0, [&](auto& a) {
-        a.balance -= value;
-    });
+    if (from->balance.amount == value.amount && is_closezero_enabled()) {
+        from_iter.erase(from);
+    } else {
+        from_iter.modify(from, 0, [&](auto& a) {
+            a.balance -= value;
+        });
+    }
 }
 
 void token::add_balance(account_name owner, extended_asset value, account_name ram_payer)
@@ -172,6 +226,8 @@ void token::add_balance(account_name owner, extended_asset value, account_name r
 
 void token::change_pst(account_name owner, extended_asset value)
 {
+    // 迁移时以 pststats 为 total_pst 初值，须在改动前迁移，否则调用方随后累加的变动会重复计入
+    migrate_maker(owner);
     pststats pst_acnts(_self, _self);
     auto st = pst_acnts.find(owner);
     if (st != pst_acnts.end()) {
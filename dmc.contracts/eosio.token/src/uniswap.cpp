@@ -33,62 +33,100 @@ void token::addreserves(account_name owner, extended_asset x, extended_asset y)
         sub_balance(owner, x);
         sub_balance(owner, y);
     }
+    uniswapdeposit(owner, x, y);
+}
+
+void token::addreservez(account_name owner, extended_asset quantity, extended_symbol pair, int64_t min_shares)
+{
+    require_auth(owner);
+
+    eosio_assert(quantity.is_valid() && pair.is_valid(), "invalid currency");
+    eosio_assert(quantity.amount > 0, "must addreserves positive amount");
+    auto in_sym = quantity.get_extended_symbol();
+    eosio_assert(in_sym != pair, "can't create market with same token");
+    if ((in_sym == rsi_sym && pair == dmc_sym) || (in_sym == dmc_sym && pair == rsi_sym))
+        eosio_assert(owner == system_account, "this market only support datamall to addreserves");
+
+    if (owner == system_account)
+        add_stats(quantity);
+    else
+        sub_balance(owner, quantity);
+
     swap_market market(_self, _self);
-    auto m_index = market.get_index<N(bysymbol)>();
-    auto m_iter = m_index.find(uniswap_market::key(sym_x, sym_y));
+    auto m_iter = find_market(market, in_sym, pair);
+    eosio_assert(m_iter != market.end(), "this uniswap pair dose not exist");
+    int64_t reserve_in = m_iter->tokenx.get_extended_symbol() == in_sym ? m_iter->tokenx.amount : m_iter->tokeny.amount;
+
+    extended_asset swap_in = extended_asset(uniswap_zap_amount(quantity.amount, reserve_in), in_sym);
+    extended_asset swap_out = extended_asset(0, pair);
+    uniswaptrade(owner, swap_in, swap_out, owner);
+
+    extended_asset x = quantity - swap_in;
+    extended_asset y = swap_out;
+    if (x.get_extended_symbol() < y.get_extended_symbol()) {
+        auto swap = x;
+        x = y;
+        y = swap;
+    }
+    auto shares = uniswapdeposit(owner, x, y);
+    eosio_assert(shares.amount >= min_shares, "add reserves shares is less than min_shares");
+}
 
-    double new_weights = static_weights;
-    uint64_t primary;
-    if (m_iter == m_index.end()) {
-        primary = market.available_primary_key();
+// x / y 已按符号排序且已从 owner 扣除，按加仓比例发行 LP 通证
+extended_asset token::uniswapdeposit(account_name owner, extended_asset x, extended_asset y)
+{
+    auto sym_x = x.get_extended_symbol();
+    auto sym_y = y.get_extended_symbol();
+    swap_market market(_self, _self);
+    auto m_iter = find_market(market, sym_x, sym_y);
+
+    auto pair_id = uniswap_market::pair_key(sym_x, sym_y);
+    extended_asset shares = extended_asset(0, m_iter == market.end() ? alloc_lp_symbol() : get_lp_symbol(*m_iter));
+    if (m_iter == market.end()) {
+        // 新兑换池直接以交易对 id 作为 swappool 的 scope
+        swap_pool pool(_self, pair_id);
+        eosio_assert(pool.begin() == pool.end(), "swap pool id collision");
+        create_lp_token(shares.get_extended_symbol(), owner);
+        shares.amount = lp_mint_shares(x.amount, y.amount, 0, 0, 0);
         market.emplace(owner, [&](auto& r) {
-            r.primary = primary;
+            r.pair_id = pair_id;
+            r.primary = pair_id;
             r.tokenx = x;
             r.tokeny = y;
-            r.total_weights = new_weights;
+            r.total_weights = 0;
+            r.legacy_shares = 0;
+            r.lp_symbol = shares.symbol;
+            r.pricex_cumulative = 0;
+            r.pricey_cumulative = 0;
+            r.updated_at = time_point_sec(now());
         });
     } else {
-        primary = m_iter->primary;
+        eosio_assert(m_iter->tokenx.amount > 0 && m_iter->tokeny.amount > 0, "insufficient liquidity");
 
         extended_asset new_x = m_iter->tokenx + x;
         extended_asset new_y = m_iter->tokeny + y;
-        double real_old_x = get_real_asset(m_iter->tokenx);
-        double real_old_y = get_real_asset(m_iter->tokeny);
-        double real_new_x = get_real_asset(new_x);
-        double real_new_y = get_real_asset(new_y);
-        uint64_t price = real_old_x / real_old_y * std::pow(2, 32);
-        uint64_t new_price = real_new_x / real_new_y * std::pow(2, 32);
-        double div = (double)new_price / (double)price;
-        eosio_assert(div <= 1.01 && div >= 0.99, "Excessive price volatility");
-
-        SEND_INLINE_ACTION(*this, pricerec, { _self, N(active) }, { price, new_price });
-        double total = std::sqrt(real_old_x) * std::sqrt(real_old_y);
-        double new_total = std::sqrt(real_new_x) * std::sqrt(real_new_y);
-
-        new_weights = (new_total - total) / total * m_iter->total_weights;
-        eosio_assert(new_weights > 0, "Invalid new weights");
-        eosio_assert(new_weights / new_weights > 0, "Invalid new weights");
-        auto total_weights = m_iter->total_weights + new_weights;
-        eosio_assert(new_weights / total_weights > 0.0001, "Add reserves too lower");
-        m_index.modify(m_iter, 0, [&](auto& s) {
+        // new_x / new_y 与 old_x / old_y 相差不超过 1%
+        uint128_t new_cross = uint128_t(new_x.amount) * m_iter->tokeny.amount;
+        uint128_t old_cross = uint128_t(m_iter->tokenx.amount) * new_y.amount;
+        uint128_t cross_diff = new_cross > old_cross ? new_cross - old_cross : old_cross - new_cross;
+        eosio_assert(cross_diff <= old_cross / 100, "Excessive price volatility");
+
+        SEND_INLINE_ACTION(*this, pricerec, { _self, N(active) }, { get_uniswap_price(m_iter->tokenx, m_iter->tokeny), get_uniswap_price(new_x, new_y) });
+
+        // 按两侧中较小的比例发行，多出的部分留在池中
+        int64_t supply = get_lp_supply(shares.get_extended_symbol());
+        shares.amount = lp_mint_shares(x.amount, y.amount, m_iter->tokenx.amount, m_iter->tokeny.amount, supply);
+        market.modify(m_iter, 0, [&](auto& s) {
+            update_cumulative(s);
             s.tokenx = new_x;
             s.tokeny = new_y;
-            s.total_weights = total_weights;
         });
     }
+    eosio_assert(shares.amount > 0, "Add reserves too lower");
 
-    swap_pool pool(_self, primary);
-    auto pool_iter = pool.find(owner);
-    if (pool_iter != pool.end()) {
-        pool.modify(pool_iter, 0, [&](auto& s) {
-            s.weights += new_weights;
-        });
-    } else {
-        pool.emplace(owner, [&](auto& s) {
-            s.owner = owner;
-            s.weights = new_weights;
-        });
-    }
+    add_stats(shares);
+    add_balance(owner, shares, owner);
+    return shares;
 }
 
 void token::outreserves(account_name owner, extended_symbol x, extended_symbol y, double rate)
@@ -105,59 +143,42 @@ void token::outreserves(account_name owner, extended_symbol x, extended_symbol y
     eosio_assert(rate > 0 && rate <= 1, "invaild rate");
 
     swap_market market(_self, _self);
-    auto m_index = market.get_index<N(bysymbol)>();
-    auto m_iter = m_index.find(uniswap_market::key(x, y));
-    eosio_assert(m_iter != m_index.end(), "no matched market record");
-
-    auto primary = m_iter->primary;
-
-    swap_pool pool(_self, m_iter->primary);
-    auto pool_iter = pool.find(owner);
-    eosio_assert(pool_iter != pool.end(), "no matched pool record");
-
-    auto owner_weights = pool_iter->weights * rate;
-    auto total_weights = m_iter->total_weights;
+    auto m_iter = find_market(market, x, y);
+    eosio_assert(m_iter != market.end(), "no matched market record");
+    convert_lp_weights(market, *m_iter, owner);
 
-    double out_rate = owner_weights / total_weights;
-
-    extended_asset x_quantity = extended_asset(std::floor(m_iter->tokenx.amount * out_rate), x);
-    extended_asset y_quantity = extended_asset(std::floor(m_iter->tokeny.amount * out_rate), y);
+    auto lp_sym = get_lp_symbol(*m_iter);
+    accounts acnts(_self, owner);
+    auto acnts_index = acnts.get_index<N(byextendedasset)>();
+    auto acnt = acnts_index.find(account::key(lp_sym));
+    eosio_assert(acnt != acnts_index.end() && acnt->balance.amount > 0, "no matched pool record");
 
+    extended_asset shares = acnt->balance;
+    if (rate != 1)
+        shares.amount = int64_t(shares.amount * rate);
+    eosio_assert(shares.amount > 0, "dust attack detected");
+
+    int64_t supply = get_lp_supply(lp_sym);
+    extended_asset x_quantity = m_iter->tokenx;
+    extended_asset y_quantity = m_iter->tokeny;
+    x_quantity.amount = lp_burn_amount(x_quantity.amount, shares.amount, supply);
+    y_quantity.amount = lp_burn_amount(y_quantity.amount, shares.amount, supply);
     eosio_assert(x_quantity.amount > 0 && y_quantity.amount > 0, "dust attack detected");
-    bool last_one = false;
-    if (rate == 1) {
-        owner_weights = pool_iter->weights;
-        pool.erase(pool_iter);
-        auto pool_begin = pool.begin();
-        if (pool_begin == pool.end()) {
-            x_quantity = m_iter->tokenx;
-            y_quantity = m_iter->tokeny;
-        } else if (++pool_begin == pool.end()) {
-            last_one = true;
-            pool_begin--;
-            owner_weights = pool_begin->weights;
-        }
+
+    sub_balance(owner, shares);
+    sub_stats(shares);
+    if (shares.amount == supply) {
+        market.erase(m_iter);
+        stats statstable(_self, lp_sym.contract);
+        statstable.erase(statstable.get(lp_sym.name()));
     } else {
-        pool.modify(pool_iter, 0, [&](auto& s) {
-            s.weights -= owner_weights;
+        market.modify(m_iter, 0, [&](auto& s) {
+            update_cumulative(s);
+            s.tokenx -= x_quantity;
+            s.tokeny -= y_quantity;
         });
-        eosio_assert(pool_iter->weights > 0, "negative pool weights amount");
+        eosio_assert(m_iter->tokenx.amount > 0 && m_iter->tokeny.amount > 0, "The remaining reserves is too low");
     }
-    m_index.modify(m_iter, 0, [&](auto& s) {
-        s.tokenx -= x_quantity;
-        s.tokeny -= y_quantity;
-        s.total_weights -= owner_weights;
-        if (last_one)
-            s.total_weights = owner_weights;
-    });
-    eosio_assert(m_iter->tokenx.amount >= 0, "negative tokenx amount");
-    eosio_assert(m_iter->tokeny.amount >= 0, "negative tokeny amount");
-    eosio_assert(m_iter->total_weights >= 0, "negative total weights amount");
-    if (m_iter->total_weights == 0)
-        m_index.erase(m_iter);
-
-    if (rate != 1)
-        eosio_assert(pool_iter->weights / m_iter->total_weights > 0.0001, "The remaining weight is too low");
 
     SEND_INLINE_ACTION(*this, outreceipt, { _self, N(active) }, { owner, x_quantity, y_quantity });
     if (owner == system_account) {
@@ -169,111 +190,337 @@ void token::outreserves(account_name owner, extended_symbol x, extended_symbol y
     }
 }
 
-void token::uniswaporder(account_name owner, extended_asset quantity, extended_asset to, double price, account_name id, account_name rampay)
+void token::swapmig(uint32_t limit)
+{
+    eosio_assert(limit > 0, "limit must be positive");
+
+    swap_market market(_self, _self);
+    legacy_swap_market legacy(_self, _self);
+    for (uint32_t i = 0; i < limit; i++) {
+        auto it = legacy.begin();
+        if (it == legacy.end())
+            break;
+        find_market(market, it->tokenx.get_extended_symbol(), it->tokeny.get_extended_symbol());
+    }
+}
+
+void token::lpmig(extended_symbol x, extended_symbol y, uint32_t limit)
+{
+    eosio_assert(limit > 0, "limit must be positive");
+
+    swap_market market(_self, _self);
+    auto m_iter = find_market(market, x, y);
+    eosio_assert(m_iter != market.end(), "no matched market record");
+
+    swap_pool pool(_self, m_iter->primary);
+    for (uint32_t i = 0; i < limit; i++) {
+        auto it = pool.begin();
+        if (it == pool.end())
+            break;
+        convert_lp_weights(market, *m_iter, it->owner);
+    }
+}
+
+void token::uniswaporder(account_name owner, extended_asset quantity, extended_asset to, account_name id, account_name rampay)
+{
+    uniswaptrade(owner, quantity, to, rampay);
+
+    add_balance(owner, to, rampay);
+    sub_balance(owner, quantity);
+
+    SEND_INLINE_ACTION(*this, uniswapsnap, { _self, N(active) },
+        { owner, to });
+}
+
+// 只更新兑换池，from / to 返回实际成交数量，不涉及账户余额
+void token::uniswaptrade(account_name owner, extended_asset& from, extended_asset& to, account_name rampay)
 {
-    auto from_sym = quantity.get_extended_symbol();
+    auto from_sym = from.get_extended_symbol();
     auto to_sym = to.get_extended_symbol();
     swap_market market(_self, _self);
-    auto m_index = market.get_index<N(bysymbol)>();
-    auto m_iter = m_index.find(uniswap_market::key(from_sym, to_sym));
-    eosio_assert(m_iter != m_index.end(), "this uniswap pair dose not exist");
+    auto m_iter = find_market(market, from_sym, to_sym);
+    eosio_assert(m_iter != market.end(), "this uniswap pair dose not exist");
 
     auto marketx = m_iter->tokenx;
     auto markety = m_iter->tokeny;
     auto marketx_sym = marketx.get_extended_symbol();
     auto markety_sym = markety.get_extended_symbol();
-    uint64_t primary = m_iter->primary;
 
     if (from_sym == marketx_sym && to_sym == markety_sym) {
-        uniswapdeal(owner, marketx, markety, quantity, to, primary, price, rampay);
+        uniswapdeal(owner, marketx, markety, from, to);
     } else if (from_sym == markety_sym && to_sym == marketx_sym) {
-        uniswapdeal(owner, markety, marketx, quantity, to, primary, price, rampay);
+        uniswapdeal(owner, markety, marketx, from, to);
     } else {
         eosio_assert(false, "symbol precision mismatch");
     }
 
-    m_index.modify(m_iter, 0, [&](auto& s) {
+    market.modify(m_iter, 0, [&](auto& s) {
+        update_cumulative(s);
+        s.tokenx = marketx;
+        s.tokeny = markety;
+    });
+}
+
+// 同一兑换池的订单按统一价格清算，双向订单先相互抵消，兑换池只承接净额
+void token::uniswapbatch(const std::vector<exchange_args>& orders)
+{
+    const auto& first = orders.front();
+    swap_market market(_self, _self);
+    auto m_iter = find_market(market, first.quantity.get_extended_symbol(), first.min_out.get_extended_symbol());
+    eosio_assert(m_iter != market.end(), "this uniswap pair dose not exist");
+
+    auto marketx = m_iter->tokenx;
+    auto markety = m_iter->tokeny;
+    auto sym_x = marketx.get_extended_symbol();
+    auto sym_y = markety.get_extended_symbol();
+
+    extended_asset in_x = extended_asset(0, sym_x);
+    extended_asset in_y = extended_asset(0, sym_y);
+    for (const auto& o : orders) {
+        auto from_sym = o.quantity.get_extended_symbol();
+        auto to_sym = o.min_out.get_extended_symbol();
+        if (from_sym == sym_x && to_sym == sym_y) {
+            in_x += o.quantity;
+        } else {
+            eosio_assert(from_sym == sym_y && to_sym == sym_x, "symbol precision mismatch");
+            in_y += o.quantity;
+        }
+    }
+
+    uint128_t price_num, price_den;
+    bool pooled = uniswap_batch_price(in_x.amount, in_y.amount, marketx.amount, markety.amount, price_num, price_den);
+
+    std::vector<extended_asset> outs;
+    extended_asset out_x = extended_asset(0, sym_x);
+    extended_asset out_y = extended_asset(0, sym_y);
+    for (const auto& o : orders) {
+        extended_asset out = extended_asset(0, o.min_out.get_extended_symbol());
+        bool from_x = o.quantity.get_extended_symbol() == sym_x;
+        out.amount = uniswap_batch_out(o.quantity.amount, from_x, price_num, price_den);
+        if (from_x)
+            out_y += out;
+        else
+            out_x += out;
+        eosio_assert(out.amount > 0, "dust attack detected in uniswap");
+        eosio_assert(out >= o.min_out, "exchange output is less than min_out");
+        outs.push_back(out);
+    }
+
+    uint64_t old_price = get_uniswap_price(marketx, markety);
+    uint128_t old_k = uint128_t(marketx.amount) * markety.amount;
+    marketx += in_x - out_x;
+    markety += in_y - out_y;
+    eosio_assert(marketx.amount > 0 && markety.amount > 0, "insufficient liquidity");
+    eosio_assert(uint128_t(marketx.amount) * markety.amount >= old_k, "uniswap invariant decreased");
+
+    market.modify(m_iter, 0, [&](auto& s) {
+        update_cumulative(s);
         s.tokenx = marketx;
         s.tokeny = markety;
     });
+    SEND_INLINE_ACTION(*this, pricerec, { _self, N(active) }, { old_price, get_uniswap_price(marketx, markety) });
+
+    // 手续费只针对进入兑换池的净额，按输入比例分摊给净流入方向的订单
+    extended_asset net_x = in_x - out_x;
+    extended_asset net_y = in_y - out_y;
+    for (size_t i = 0; i < orders.size(); i++) {
+        const auto& o = orders[i];
+        const auto& net = (o.quantity.get_extended_symbol() == sym_x) ? net_x : net_y;
+        const auto& total = (o.quantity.get_extended_symbol() == sym_x) ? in_x : in_y;
+        auto fee = extended_asset(0, o.quantity.get_extended_symbol());
+        if (pooled && net.amount > 0)
+            fee.amount = int64_t((uint128_t(net.amount) * uniswap_fee_rate + uniswap_fee_base - 1) / uniswap_fee_base * o.quantity.amount / total.amount);
+        SEND_INLINE_ACTION(*this, traderecord, { _self, N(active) },
+            { o.owner, eos_account, o.quantity, outs[i], fee, 0 });
+
+        sub_balance(o.owner, o.quantity);
+        add_balance(o.owner, outs[i], o.owner);
+        SEND_INLINE_ACTION(*this, uniswapsnap, { _self, N(active) },
+            { o.owner, outs[i] });
+    }
 }
 
-void token::uniswapdeal(account_name owner, extended_asset& market_from, extended_asset& market_to, extended_asset from, extended_asset to, uint64_t primary, double price, account_name rampay)
+void token::uniswapdeal(account_name owner, extended_asset& market_from, extended_asset& market_to, extended_asset& from, extended_asset& to)
 {
     auto from_sym = from.get_extended_symbol();
     auto to_sym = to.get_extended_symbol();
-    double real_market_from = get_real_asset(market_from);
-    double real_market_to = get_real_asset(market_to);
-    double real_market_total = real_market_from * real_market_to;
-    uint64_t min_price = real_market_from / real_market_to * std::pow(2, 32);
-    uint64_t price_t = price * std::pow(2, 32);
     bool buy = (from.amount == 0) ? true : false;
-    bool limit = (price_t == 0) ? false : true;
-    bool first = true;
+    uint64_t old_price = get_uniswap_price(market_from, market_to);
 
     extended_asset sub_asset = extended_asset(0, from_sym);
     extended_asset add_asset = extended_asset(0, to_sym);
-    extended_asset from_scrap = extended_asset(0, from_sym);
-    extended_asset to_scrap = extended_asset(0, to_sym);
-    uint64_t new_price_t = uint64_max;
-    double new_price;
     if (buy) {
-        extended_asset new_to = market_to - to;
-        if (new_to.amount > 0) {
-            double real_new_to = get_real_asset(new_to);
-            new_price = real_market_total / (real_new_to * real_new_to);
-            new_price_t = new_price * std::pow(2, 32);
-        }
+        add_asset.amount = to.amount;
+        sub_asset.amount = uniswap_amount_in(to.amount, market_from.amount, market_to.amount);
     } else {
-        extended_asset new_from = market_from + from;
-        double real_new_from = get_real_asset(new_from);
-        new_price = (real_new_from * real_new_from) / real_market_total;
-        new_price_t = new_price * std::pow(2, 32);
+        sub_asset.amount = from.amount;
+        add_asset.amount = uniswap_amount_out(from.amount, market_from.amount, market_to.amount);
     }
+    eosio_assert(sub_asset.amount > 0 && add_asset.amount > 0, "dust attack detected in uniswap");
+
+    // 手续费按输入计算并留在池中
+    auto from_fee = extended_asset((uint128_t(sub_asset.amount) * uniswap_fee_rate + uniswap_fee_base - 1) / uniswap_fee_base, from_sym);
 
-    auto old_price = min_price;
-    price_t = limit ? price_t : new_price_t;
-    min_price = price_t;
-    min_price = std::min(min_price, new_price_t);
-
-    double real_new_from;
-    extended_asset spread_from;
-    double cal_price = std::sqrt(min_price / std::pow(2, 32));
-    if (min_price == new_price_t && min_price != uint64_max)
-        cal_price = std::sqrt(new_price);
-    real_new_from = cal_price * std::sqrt(real_market_total);
-    extended_asset new_market_from = get_asset_by_amount<double, std::round>(real_new_from, from_sym);
-    spread_from = new_market_from - market_from;
-    market_from = new_market_from;
-
-    auto real_new_to = real_market_total / real_new_from;
-    auto new_market_to = get_asset_by_amount<double, std::round>(real_new_to, to_sym);
-    auto spread_ex_to = market_to - new_market_to;
-    market_to = new_market_to;
-    auto to_fee = extended_asset(std::ceil(spread_ex_to.amount * uniswap_fee), spread_ex_to.get_extended_symbol());
-    extended_asset spread_to = spread_ex_to - to_fee;
-    to_scrap += to_fee;
-    eosio_assert(spread_from.amount > 0 && spread_to.amount > 0, "dust attack detected in uniswap");
-
-    from -= spread_from;
-    to -= spread_ex_to;
-    eosio_assert(from.amount >= 0 || to.amount >= 0, "can't sub/add negative asset"); // never happened
-
-    sub_asset += spread_from;
-    add_asset += spread_to;
-
-    SEND_INLINE_ACTION(*this, pricerec, { _self, N(active) }, { old_price, min_price });
+    uint128_t old_k = uint128_t(market_from.amount) * market_to.amount;
+    market_from += sub_asset;
+    market_to -= add_asset;
+    eosio_assert(uint128_t(market_from.amount) * market_to.amount >= old_k, "uniswap invariant decreased"); // never happened
+
+    SEND_INLINE_ACTION(*this, pricerec, { _self, N(active) }, { old_price, get_uniswap_price(market_from, market_to) });
     SEND_INLINE_ACTION(*this, traderecord, { _self, N(active) },
-        { owner, eos_account, spread_from, spread_to, to_fee, 0 });
+        { owner, eos_account, sub_asset, add_asset, from_fee, 0 });
 
-    add_balance(owner, add_asset, rampay);
-    sub_balance(owner, sub_asset);
+    from = sub_asset;
+    to = add_asset;
+}
 
-    market_from += from_scrap;
-    market_to += to_scrap;
+// market_from / market_to 的实际价格，以 2^32 为定点
+uint64_t token::get_uniswap_price(extended_asset market_from, extended_asset market_to)
+{
+    if (market_to.amount <= 0)
+        return uint64_max;
+
+    uint128_t price = (uint128_t(market_from.amount) << 32) / market_to.amount;
+    int64_t precision_diff = int64_t(market_to.get_extended_symbol().precision()) - int64_t(market_from.get_extended_symbol().precision());
+    for (; precision_diff > 0 && price <= uint64_max; precision_diff--)
+        price *= 10;
+    for (; precision_diff < 0; precision_diff++)
+        price /= 10;
+    return price > uint64_max ? uint64_max : uint64_t(price);
+}
 
-    SEND_INLINE_ACTION(*this, uniswapsnap, { _self, N(active) },
-        { owner, add_asset });
+// 在修改储备的同一次 modify 中、改动储备之前调用，累计值允许溢出回绕
+void token::update_cumulative(uniswap_market& m)
+{
+    auto now_time = time_point_sec(now());
+    uint64_t elapsed = now_time.sec_since_epoch() - m.updated_at.sec_since_epoch();
+    if (elapsed == 0)
+        return;
+
+    m.pricex_cumulative += uint128_t(get_uniswap_price(m.tokeny, m.tokenx)) * elapsed;
+    m.pricey_cumulative += uint128_t(get_uniswap_price(m.tokenx, m.tokeny)) * elapsed;
+    m.updated_at = now_time;
+}
+
+// 按交易对 id 直接查找兑换池，swapmarket 中的旧记录在首次访问时迁入 swappairs
+token::swap_market::const_iterator token::find_market(swap_market& market, extended_symbol x, extended_symbol y)
+{
+    auto pair_id = uniswap_market::pair_key(x, y);
+    auto m_iter = market.find(pair_id);
+    if (m_iter != market.end()) {
+        eosio_assert(m_iter->match(x, y), "swap pair id collision");
+        return m_iter;
+    }
+
+    legacy_swap_market legacy(_self, _self);
+    auto l_index = legacy.get_index<N(bysymbol)>();
+    auto l_iter = l_index.find(legacy_uniswap_market::key(x, y));
+    if (l_iter == l_index.end())
+        return m_iter;
+
+    // 旧份额整体折算为 sqrt(x * y) 个 LP 通证，由 swappool 中的持有者按比例领取
+    auto lp_sym = alloc_lp_symbol();
+    create_lp_token(lp_sym, _self);
+    int64_t legacy_shares = integer_sqrt(uint128_t(l_iter->tokenx.amount) * l_iter->tokeny.amount);
+    if (legacy_shares > 0)
+        add_stats(extended_asset(legacy_shares, lp_sym));
+
+    // 旧记录的 RAM 退还原付费账户，新记录由合约支付
+    m_iter = market.emplace(_self, [&](auto& r) {
+        r.pair_id = pair_id;
+        r.primary = l_iter->primary;
+        r.tokenx = l_iter->tokenx;
+        r.tokeny = l_iter->tokeny;
+        r.total_weights = l_iter->total_weights;
+        r.legacy_shares = legacy_shares;
+        r.lp_symbol = lp_sym;
+        r.pricex_cumulative = 0;
+        r.pricey_cumulative = 0;
+        r.updated_at = time_point_sec(now());
+    });
+    l_index.erase(l_iter);
+    return m_iter;
+}
+
+// 将 owner 在 swappool 中的旧份额按比例转换为 LP 通证，最后一个持有者领取剩余全部
+void token::convert_lp_weights(swap_market& market, const uniswap_market& m, account_name owner)
+{
+    swap_pool pool(_self, m.primary);
+    auto pool_iter = pool.find(owner);
+    if (pool_iter == pool.end())
+        return;
+
+    double weights = pool_iter->weights;
+    pool.erase(pool_iter);
+    bool last_one = pool.begin() == pool.end();
+
+    int64_t shares = m.legacy_shares;
+    if (!last_one && weights < m.total_weights)
+        shares = std::min(shares, int64_t(m.legacy_shares * (weights / m.total_weights)));
+    market.modify(m, 0, [&](auto& s) {
+        s.total_weights = last_one ? 0 : s.total_weights - weights;
+        s.legacy_shares -= shares;
+    });
+    if (shares > 0)
+        add_balance(owner, extended_asset(shares, get_lp_symbol(m)), _self);
+}
+
+// LP 通证由本合约发行，精度为 0，符号为 lpsymbol 序列号按 26 进制写成的 7 个大写字母
+// 序列单调递增，不同兑换池的符号不会重复，也无法通过挑选交易对抢占
+extended_symbol token::alloc_lp_symbol()
+{
+    uint64_t seq = next_id(N(lpsymbol));
+    eosio_assert(seq < 8031810176, "lp symbols are used up"); // 26^7
+    uint64_t value = 0;
+    for (int i = 0; i < 7; i++) {
+        value |= uint64_t('A' + seq % 26) << (8 * (i + 1));
+        seq /= 26;
+    }
+    return extended_symbol(symbol_type(value), _self);
+}
+
+extended_symbol token::get_lp_symbol(const uniswap_market& m)
+{
+    return extended_symbol(m.lp_symbol, _self);
+}
+
+void token::create_lp_token(extended_symbol lp_sym, account_name payer)
+{
+    stats statstable(_self, lp_sym.contract);
+    eosio_assert(statstable.find(lp_sym.name()) == statstable.end(), "lp symbol collision");
+    statstable.emplace(payer, [&](auto& s) {
+        s.issuer = lp_sym.contract;
+        s.max_supply = asset(asset::max_amount, lp_sym);
+        s.supply.symbol = lp_sym;
+        s.reserve_supply.symbol = lp_sym;
+    });
+}
+
+int64_t token::get_lp_supply(extended_symbol lp_sym)
+{
+    stats statstable(_self, lp_sym.contract);
+    const auto& st = statstable.get(lp_sym.name(), "lp token does not exist");
+    // 锁仓中的 LP 通证计入 reserve_supply，仍按份额参与分配
+    int64_t supply = st.supply.amount;
+    if (st.reserve_supply.symbol == st.supply.symbol)
+        supply += st.reserve_supply.amount;
+    return supply;
+}
+
+// LP 通证由本合约发行，精度为 0，符号为 7 个大写字母
+bool token::is_lp_symbol(extended_symbol sym)
+{
+    if (sym.contract != _self || sym.precision() != 0)
+        return false;
+
+    uint64_t value = sym.name();
+    for (int i = 0; i < 7; i++) {
+        char c = char(value & 0xff);
+        if (c < 'A' || c > 'Z')
+            return false;
+        value >>= 8;
+    }
+    return value == 0;
 }
 
 double token::get_real_asset(extended_asset quantity)
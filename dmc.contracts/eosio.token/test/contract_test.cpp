@@ -0,0 +1,537 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ *
+ *  合约的主机端测试：以 test/mock 中的 eosiolib 替身编译整个合约，直接调用 action 并检查表中状态
+ */
+#include <cstdio>
+#include <eosiolib/asset.hpp>
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/time.hpp>
+#include <eosiolib/transaction.h>
+
+// 测试需要直接读写合约的私有表
+#define private public
+#include "../src/eosio.token.cpp"
+#undef private
+
+using namespace eosio;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static const account_name self = N(eosio.token);
+
+// 每个用例从空链开始
+static void reset_chain()
+{
+    for (auto table : mock::tables())
+        table->clear();
+    mock::chain() = mock::chain_state();
+    mock::chain().receiver = self;
+    mock::chain().accounts = { self, eos_account, system_account, abo_account };
+}
+
+static void create_account(account_name account)
+{
+    mock::chain().accounts.insert(account);
+}
+
+// 以 actor 的授权执行一个 action，失败时回滚所有表并返回错误信息
+template <typename F>
+static std::string push(account_name actor, F f)
+{
+    for (auto table : mock::tables())
+        table->save();
+    mock::chain().auths = { actor };
+    std::string error;
+    try {
+        token t(self);
+        f(t);
+    } catch (const mock::assert_error& e) {
+        error = e.what();
+        for (auto table : mock::tables())
+            table->restore();
+    }
+    mock::chain().auths.clear();
+    return error;
+}
+
+static void create_pst()
+{
+    std::string error = push(system_account, [](token& t) {
+        t.excreate(system_account, asset(10000000000, pst_sym), asset(0, pst_sym), time_point_sec());
+    });
+    CHECK(error.empty());
+}
+
+static extended_asset pst(int64_t amount)
+{
+    return extended_asset(amount, pst_sym);
+}
+
+// 迁移前的矿工记录，没有 total_pst 字段
+static void add_legacy_maker(account_name miner)
+{
+    token::legacy_dmc_makers legacy_tbl(self, self);
+    legacy_tbl.emplace(self, [&](auto& m) {
+        m.miner = miner;
+        m.current_rate = 0;
+        m.miner_rate = 1;
+        m.total_weight = 1;
+        m.total_staked = extended_asset(1000000, dmc_sym);
+    });
+}
+
+static int64_t maker_pst(account_name miner)
+{
+    token::dmc_makers maker_tbl(self, self);
+    return maker_tbl.get(miner, "maker not migrated").total_pst;
+}
+
+static int64_t pststats_amount(account_name owner)
+{
+    token::pststats pst_acnts(self, self);
+    auto st = pst_acnts.find(owner);
+    return st != pst_acnts.end() ? st->amount.amount : 0;
+}
+
+// 未迁移的矿工增发/销毁 PST 后，迁移出的 total_pst 只计一次变动
+static void test_pst_change_on_legacy_maker()
+{
+    reset_chain();
+    account_name miner = N(miner);
+    create_account(miner);
+    create_pst();
+
+    add_legacy_maker(miner);
+    std::string error = push(system_account, [&](token& t) {
+        t.exissue(miner, pst(100), "");
+    });
+    CHECK(error.empty());
+    CHECK(pststats_amount(miner) == 100);
+    CHECK(maker_pst(miner) == 100);
+
+    // 已有 PST 的矿工在迁移前销毁
+    account_name holder = N(holder);
+    create_account(holder);
+    error = push(system_account, [&](token& t) {
+        t.exissue(holder, pst(100), "");
+    });
+    CHECK(error.empty());
+    add_legacy_maker(holder);
+    error = push(holder, [&](token& t) {
+        t.exretire(holder, pst(40), "");
+    });
+    CHECK(error.empty());
+    CHECK(pststats_amount(holder) == 60);
+    CHECK(maker_pst(holder) == 60);
+
+    // 迁移后的增发照常累加
+    error = push(system_account, [&](token& t) {
+        t.exissue(holder, pst(15), "");
+    });
+    CHECK(error.empty());
+    CHECK(pststats_amount(holder) == 75);
+    CHECK(maker_pst(holder) == 75);
+}
+
+// 抽查只能由系统账户发起，且单次尝试次数受 samplecall 限制
+static void test_samplechall_auth_and_cap()
+{
+    reset_chain();
+    account_name anyone = N(anyone);
+    create_account(anyone);
+
+    std::string error = push(anyone, [](token& t) {
+        t.samplechall(1);
+    });
+    CHECK(error == "missing required authority");
+
+    error = push(eos_account, [](token& t) {
+        t.samplechall(default_sample_per_call + 1);
+    });
+    CHECK(error == "too many samples in one call");
+
+    error = push(eos_account, [](token& t) {
+        t.samplechall(default_sample_per_call);
+    });
+    CHECK(error.empty());
+}
+
+static extended_symbol create_token(symbol_name sym)
+{
+    std::string error = push(system_account, [&](token& t) {
+        t.excreate(system_account, asset(asset::max_amount, sym), asset(0, sym), time_point_sec());
+    });
+    CHECK(error.empty());
+    return extended_symbol(sym, system_account);
+}
+
+static int64_t balance_of(account_name owner, extended_symbol sym)
+{
+    token::accounts acnts(self, owner);
+    auto idx = acnts.get_index<N(byextendedasset)>();
+    auto it = idx.find(token::account::key(sym));
+    return it != idx.end() ? it->balance.amount : 0;
+}
+
+// LP 通证符号由序列分配并记录在兑换池上，与交易对 id 无关
+static void test_lp_symbol_sequence()
+{
+    reset_chain();
+    auto a = create_token(S(4, AAA));
+    auto b = create_token(S(4, BBB));
+    auto c = create_token(S(4, CCC));
+
+    std::string error = push(system_account, [&](token& t) {
+        t.addreserves(system_account, extended_asset(1000000, a), extended_asset(4000000, b));
+    });
+    CHECK(error.empty());
+    error = push(system_account, [&](token& t) {
+        t.addreserves(system_account, extended_asset(1000000, a), extended_asset(9000000, c));
+    });
+    CHECK(error.empty());
+
+    token::swap_market market(self, self);
+    const auto& ab = market.get(token::uniswap_market::pair_key(a, b));
+    const auto& ac = market.get(token::uniswap_market::pair_key(a, c));
+    CHECK(ab.lp_symbol.value == S(0, BAAAAAA));
+    CHECK(ac.lp_symbol.value == S(0, CAAAAAA));
+
+    token t(self);
+    CHECK(t.is_lp_symbol(extended_symbol(ab.lp_symbol, self)));
+    CHECK(balance_of(system_account, extended_symbol(ab.lp_symbol, self)) == 2000000);
+    CHECK(balance_of(system_account, extended_symbol(ac.lp_symbol, self)) == 3000000);
+}
+
+// 累计价格记录在兑换池上，按变动前的储备与经过的时间累加
+static void test_swap_cumulative_price()
+{
+    reset_chain();
+    auto a = create_token(S(4, AAA));
+    auto b = create_token(S(4, BBB));
+    std::string error = push(system_account, [&](token& t) {
+        t.addreserves(system_account, extended_asset(1000000, a), extended_asset(4000000, b));
+    });
+    CHECK(error.empty());
+
+    token::swap_market market(self, self);
+    auto pair_id = token::uniswap_market::pair_key(a, b);
+    auto before = market.get(pair_id);
+    CHECK(before.pricex_cumulative == 0 && before.updated_at == time_point_sec(now()));
+
+    mock::chain().now += 100;
+    error = push(system_account, [&](token& t) {
+        t.outreserves(system_account, a, b, 0.5);
+    });
+    CHECK(error.empty());
+    token t(self);
+    const auto& after = market.get(pair_id);
+    CHECK(after.pricex_cumulative == uint128_t(t.get_uniswap_price(before.tokeny, before.tokenx)) * 100);
+    CHECK(after.pricey_cumulative == uint128_t(t.get_uniswap_price(before.tokenx, before.tokeny)) * 100);
+    CHECK(after.updated_at == time_point_sec(now()));
+}
+
+static int64_t locked_of(account_name owner, extended_symbol sym, uint32_t lock_timestamp)
+{
+    token t(self);
+    uint64_t bucket_id = t.find_lock_bucket(owner, sym);
+    if (bucket_id == 0)
+        return 0;
+    token::lock_balances lock_tbl(self, bucket_id);
+    auto it = lock_tbl.find(lock_timestamp);
+    return it != lock_tbl.end() ? it->balance.amount : 0;
+}
+
+// 同名不同发行者的锁仓分属不同分组，互不影响；旧记录由 owner 迁移并支付 RAM
+static void test_lock_buckets()
+{
+    reset_chain();
+    account_name alice = N(alice), bob = N(bob), user = N(user);
+    for (auto a : { alice, bob, user })
+        create_account(a);
+
+    uint32_t expire_at = now() + 100;
+    extended_symbol alice_sym(S(4, AAA), alice), bob_sym(S(4, AAA), bob);
+    for (auto sym : { alice_sym, bob_sym }) {
+        std::string error = push(sym.contract, [&](token& t) {
+            t.excreate(sym.contract, asset(1000000, sym), asset(0, sym), time_point_sec(now() + 1000));
+            t.exissue(user, extended_asset(1000, sym), "");
+        });
+        CHECK(error.empty());
+    }
+
+    std::string error = push(user, [&](token& t) {
+        t.exlock(user, extended_asset(100, alice_sym), time_point_sec(expire_at), "");
+        t.exlock(user, extended_asset(200, bob_sym), time_point_sec(expire_at), "");
+    });
+    CHECK(error.empty());
+    CHECK(locked_of(user, alice_sym, expire_at) == 100);
+    CHECK(locked_of(user, bob_sym, expire_at) == 200);
+
+    mock::chain().now = expire_at;
+    error = push(user, [&](token& t) {
+        t.exunlock(user, extended_asset(100, alice_sym), time_point_sec(expire_at), "");
+    });
+    CHECK(error.empty());
+    CHECK(token(self).find_lock_bucket(user, alice_sym) == 0);
+    CHECK(locked_of(user, bob_sym, expire_at) == 200);
+    CHECK(balance_of(user, alice_sym) == 1000);
+
+    // 迁移前的旧记录
+    token::legacy_lock_accounts legacy_acnts(self, user);
+    legacy_acnts.emplace(self, [&](auto& a) {
+        a.primary = 0;
+        a.balance = extended_asset(50, bob_sym);
+        a.lock_timestamp = time_point_sec(expire_at);
+    });
+    legacy_acnts.emplace(self, [&](auto& a) {
+        a.primary = 1;
+        a.balance = extended_asset(70, alice_sym);
+        a.lock_timestamp = time_point_sec(expire_at + 1);
+    });
+    error = push(bob, [&](token& t) {
+        t.lockmig(user, 10);
+    });
+    CHECK(error == "missing required authority");
+    error = push(user, [&](token& t) {
+        t.lockmig(user, 10);
+    });
+    CHECK(error.empty());
+    CHECK(legacy_acnts.begin() == legacy_acnts.end());
+    CHECK(locked_of(user, bob_sym, expire_at) == 250);
+    CHECK(locked_of(user, alice_sym, expire_at + 1) == 70);
+    token::lock_balances lock_tbl(self, token(self).find_lock_bucket(user, alice_sym));
+    CHECK(lock_tbl.payer_of(expire_at + 1) == user);
+}
+
+// 没有预留量时 excreate 不创建锁仓记录；到期转出单次处理的记录数有上限
+static void test_lock_walk_limit()
+{
+    reset_chain();
+    account_name issuer = N(issuer), user = N(user);
+    create_account(issuer);
+    create_account(user);
+    extended_symbol sym(S(4, AAA), issuer);
+
+    std::string error = push(issuer, [&](token& t) {
+        t.excreate(issuer, asset(1000000, sym), asset(0, sym), time_point_sec(now() + 1000));
+        t.exissue(user, extended_asset(1000, sym), "");
+    });
+    CHECK(error.empty());
+    CHECK(token(self).find_lock_bucket(issuer, sym) == 0);
+
+    uint32_t expire_at = now() + 100;
+    error = push(user, [&](token& t) {
+        for (uint32_t i = 0; i <= lock_walk_limit; i++)
+            t.exlock(user, extended_asset(1, sym), time_point_sec(expire_at + i), "");
+    });
+    CHECK(error.empty());
+
+    mock::chain().now = expire_at + lock_walk_limit;
+    error = push(user, [&](token& t) {
+        t.exlocktrans(user, issuer, extended_asset(lock_walk_limit + 1, sym), time_point_sec(expire_at), time_point_sec(), "");
+    });
+    CHECK(error == "too many lock records in one call, split the quantity");
+    error = push(user, [&](token& t) {
+        t.exlocktrans(user, issuer, extended_asset(lock_walk_limit, sym), time_point_sec(expire_at), time_point_sec(), "");
+    });
+    CHECK(error.empty());
+    CHECK(locked_of(issuer, sym, 0) == int64_t(lock_walk_limit));
+    CHECK(locked_of(user, sym, expire_at + lock_walk_limit) == 1);
+}
+
+// 幂等键随 bill 一起提交，重复提交失败，0 表示不登记
+static void test_bill_request_key()
+{
+    reset_chain();
+    account_name miner = N(miner);
+    create_account(miner);
+    create_pst();
+    std::string error = push(system_account, [&](token& t) {
+        t.exissue(miner, pst(100), "");
+    });
+    CHECK(error.empty());
+
+    error = push(miner, [](token& t) {
+        t.bill(N(miner), pst(10), 1, 42, "");
+    });
+    CHECK(error.empty());
+    error = push(miner, [](token& t) {
+        t.bill(N(miner), pst(10), 1, 42, "");
+    });
+    CHECK(error == "duplicate request key");
+    for (int i = 0; i < 2; i++) {
+        error = push(miner, [](token& t) {
+            t.bill(N(miner), pst(10), 1, 0, "");
+        });
+        CHECK(error.empty());
+    }
+
+    token::request_keys key_tbl(self, miner);
+    CHECK(key_tbl.get(42).id == 1);
+    CHECK(++key_tbl.begin() == key_tbl.end());
+    token::bill_stats sst(self, miner);
+    CHECK(sst.find(3) != sst.end());
+}
+
+// 到期挂单由系统账户清理，只修改 owner 已有的余额记录
+static void test_expirebills_ram_payer()
+{
+    reset_chain();
+    account_name miner = N(miner), anyone = N(anyone);
+    create_account(miner);
+    create_account(anyone);
+    create_pst();
+    create_token(rsi_sym.value);
+    std::string error = push(system_account, [&](token& t) {
+        t.exissue(miner, pst(100), "");
+    });
+    CHECK(error.empty());
+    error = push(miner, [](token& t) {
+        t.bill(N(miner), pst(10), 1, 0, "");
+    });
+    CHECK(error.empty());
+
+    mock::chain().now += default_bill_dmc_claims_interval;
+    error = push(anyone, [](token& t) {
+        t.expirebills(10);
+    });
+    CHECK(error == "missing required authority");
+
+    // 没有 RSI 余额记录，挂单留给 owner 自行 unbill
+    error = push(eos_account, [](token& t) {
+        t.expirebills(10);
+    });
+    CHECK(error.empty());
+    token::bill_stats sst(self, miner);
+    CHECK(sst.find(1) != sst.end());
+    CHECK(balance_of(miner, pst_sym) == 90);
+
+    token::accounts acnts(self, miner);
+    acnts.emplace(miner, [&](auto& a) {
+        a.primary = acnts.available_primary_key();
+        a.balance = extended_asset(0, rsi_sym);
+    });
+    error = push(eos_account, [](token& t) {
+        t.expirebills(10);
+    });
+    CHECK(error.empty());
+    CHECK(sst.find(1) == sst.end());
+    CHECK(balance_of(miner, pst_sym) == 100);
+    CHECK(balance_of(miner, rsi_sym) > 0);
+    for (auto it = acnts.begin(); it != acnts.end(); it++)
+        CHECK(acnts.payer_of(it->primary) != self);
+}
+
+// statsmig 完成前全局统计标记为不完整
+static void test_stats_incomplete_flag()
+{
+    reset_chain();
+    account_name miner = N(miner);
+    create_account(miner);
+    create_pst();
+    std::string error = push(system_account, [&](token& t) {
+        t.exissue(miner, pst(100), "");
+    });
+    CHECK(error.empty());
+    error = push(miner, [](token& t) {
+        t.bill(N(miner), pst(10), 1, 0, "");
+    });
+    CHECK(error.empty());
+
+    token::market_stats market_tbl(self, self);
+    CHECK(market_tbl.get(0).incomplete);
+    CHECK(market_tbl.get(0).bill_pst == 10);
+
+    error = push(miner, [&](token& t) {
+        t.statsmig(miner, 10);
+    });
+    CHECK(error.empty());
+    CHECK(!market_tbl.get(0).incomplete);
+
+    error = push(miner, [](token& t) {
+        t.bill(N(miner), pst(5), 1, 0, "");
+    });
+    CHECK(error.empty());
+    CHECK(!market_tbl.get(0).incomplete);
+    CHECK(market_tbl.get(0).bill_pst == 15);
+}
+
+// 释放由任意账户触发，入账附带原 issue 的备注
+static void test_allocation_receipt()
+{
+    reset_chain();
+    account_name keeper = N(keeper);
+    create_account(keeper);
+    create_token(dmc_sym.value);
+
+    token::abostats ast(self, self);
+    ast.emplace(self, [&](auto& a) {
+        a.stage = 1;
+        a.user_rate = 0.6;
+        a.foundation_rate = 0.4;
+        a.total_release = extended_asset(1000000, dmc_sym);
+        a.remaining_release = a.total_release;
+        a.start_at = time_point_sec(now());
+        a.end_at = time_point_sec(now() + 10 * 86400);
+        a.last_released_at = a.start_at;
+    });
+
+    mock::chain().now += 86400;
+    std::string error = push(keeper, [](token& t) {
+        t.allocation("");
+    });
+    CHECK(error.empty());
+    CHECK(balance_of(system_account, dmc_sym) == 40000);
+    CHECK(balance_of(abo_account, dmc_sym) == 60000);
+
+    const auto& actions = mock::chain().actions;
+    CHECK(actions.size() == 2);
+    for (const auto& a : actions)
+        CHECK(a.account == self && a.name == N(allocrec));
+    typedef std::tuple<account_name, extended_asset, std::string> allocrec_args;
+    auto foundation = std::any_cast<allocrec_args>(actions[0].data);
+    CHECK(std::get<0>(foundation) == system_account);
+    CHECK(std::get<2>(foundation) == "allocation to foundation");
+    auto user = std::any_cast<allocrec_args>(actions[1].data);
+    CHECK(std::get<0>(user) == abo_account);
+    CHECK(std::get<1>(user).amount == 60000);
+    CHECK(std::get<2>(user) == std::to_string(now() + 86400) + ";RSI@datamall");
+
+    // 同一天内再次调用不会重复释放
+    error = push(keeper, [](token& t) {
+        t.allocation("");
+    });
+    CHECK(error.empty());
+    CHECK(balance_of(abo_account, dmc_sym) == 60000);
+}
+
+int main()
+{
+    test_pst_change_on_legacy_maker();
+    test_samplechall_auth_and_cap();
+    test_lp_symbol_sequence();
+    test_swap_cumulative_price();
+    test_lock_buckets();
+    test_lock_walk_limit();
+    test_bill_request_key();
+    test_expirebills_ram_payer();
+    test_stats_incomplete_flag();
+    test_allocation_receipt();
+
+    if (failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("all contract tests passed\n");
+    return 0;
+}
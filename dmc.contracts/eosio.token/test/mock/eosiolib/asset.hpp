@@ -0,0 +1,245 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ */
+#pragma once
+#include <eosiolib/eosio.hpp>
+
+namespace eosio {
+
+constexpr uint64_t string_to_symbol(uint8_t precision, const char* str)
+{
+    uint32_t len = 0;
+    while (str[len])
+        ++len;
+    uint64_t result = 0;
+    for (uint32_t i = 0; i < len; ++i)
+        result |= (uint64_t(str[i]) << (8 * (1 + i)));
+    result |= uint64_t(precision);
+    return result;
+}
+
+#define S(P, X) ::eosio::string_to_symbol(P, #X)
+
+typedef uint64_t symbol_name;
+
+inline bool is_valid_symbol(symbol_name sym)
+{
+    sym >>= 8;
+    for (int i = 0; i < 7; ++i) {
+        char c = char(sym & 0xff);
+        if (!('A' <= c && c <= 'Z'))
+            return false;
+        sym >>= 8;
+        if (!(sym & 0xff)) {
+            do {
+                sym >>= 8;
+                if ((sym & 0xff))
+                    return false;
+                ++i;
+            } while (i < 7);
+        }
+    }
+    return true;
+}
+
+struct symbol_type {
+    symbol_name value = 0;
+
+    symbol_type() {}
+    symbol_type(symbol_name s)
+        : value(s)
+    {
+    }
+    bool is_valid() const { return is_valid_symbol(value); }
+    uint64_t precision() const { return value & 0xff; }
+    uint64_t name() const { return value >> 8; }
+    operator symbol_name() const { return value; }
+};
+
+struct extended_symbol : public symbol_type {
+    extended_symbol(symbol_name sym = 0, account_name acc = 0)
+        : symbol_type { sym }
+        , contract(acc)
+    {
+    }
+
+    account_name contract;
+
+    friend bool operator==(const extended_symbol& a, const extended_symbol& b)
+    {
+        return std::tie(a.value, a.contract) == std::tie(b.value, b.contract);
+    }
+    friend bool operator!=(const extended_symbol& a, const extended_symbol& b) { return !(a == b); }
+    friend bool operator<(const extended_symbol& a, const extended_symbol& b)
+    {
+        return std::tie(a.value, a.contract) < std::tie(b.value, b.contract);
+    }
+};
+
+struct asset {
+    // wasm 上 int64_t 即 long long，合约中有按 long long 推导的写法
+    long long amount;
+    symbol_type symbol;
+
+    static constexpr int64_t max_amount = (1LL << 62) - 1;
+
+    explicit asset(int64_t a = 0, symbol_type s = symbol_type())
+        : amount(a)
+        , symbol { s }
+    {
+        eosio_assert(is_amount_within_range(), "magnitude of asset amount must be less than 2^62");
+    }
+
+    bool is_amount_within_range() const { return -max_amount <= amount && amount <= max_amount; }
+    bool is_valid() const { return is_amount_within_range() && symbol.is_valid(); }
+
+    asset operator-() const
+    {
+        asset r = *this;
+        r.amount = -r.amount;
+        return r;
+    }
+
+    asset& operator-=(const asset& a)
+    {
+        eosio_assert(a.symbol == symbol, "attempt to subtract asset with different symbol");
+        amount -= a.amount;
+        eosio_assert(-max_amount <= amount, "subtraction underflow");
+        eosio_assert(amount <= max_amount, "subtraction overflow");
+        return *this;
+    }
+
+    asset& operator+=(const asset& a)
+    {
+        eosio_assert(a.symbol == symbol, "attempt to add asset with different symbol");
+        amount += a.amount;
+        eosio_assert(-max_amount <= amount, "addition underflow");
+        eosio_assert(amount <= max_amount, "addition overflow");
+        return *this;
+    }
+
+    asset& operator*=(int64_t a)
+    {
+        int128_t tmp = int128_t(amount) * int128_t(a);
+        eosio_assert(tmp <= max_amount, "multiplication overflow");
+        eosio_assert(tmp >= -max_amount, "multiplication underflow");
+        amount = int64_t(tmp);
+        return *this;
+    }
+
+    asset& operator/=(int64_t a)
+    {
+        eosio_assert(a != 0, "divide by zero");
+        eosio_assert(!(amount == std::numeric_limits<int64_t>::min() && a == -1), "signed division overflow");
+        amount /= a;
+        return *this;
+    }
+
+    friend asset operator+(const asset& a, const asset& b)
+    {
+        asset r = a;
+        r += b;
+        return r;
+    }
+    friend asset operator-(const asset& a, const asset& b)
+    {
+        asset r = a;
+        r -= b;
+        return r;
+    }
+    friend asset operator*(const asset& a, int64_t b)
+    {
+        asset r = a;
+        r *= b;
+        return r;
+    }
+    friend asset operator/(const asset& a, int64_t b)
+    {
+        asset r = a;
+        r /= b;
+        return r;
+    }
+    friend int64_t operator/(const asset& a, const asset& b)
+    {
+        eosio_assert(b.amount != 0, "divide by zero");
+        eosio_assert(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+        return a.amount / b.amount;
+    }
+    friend bool operator==(const asset& a, const asset& b)
+    {
+        eosio_assert(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+        return a.amount == b.amount;
+    }
+    friend bool operator!=(const asset& a, const asset& b) { return !(a == b); }
+    friend bool operator<(const asset& a, const asset& b)
+    {
+        eosio_assert(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+        return a.amount < b.amount;
+    }
+    friend bool operator<=(const asset& a, const asset& b) { return !(b < a); }
+    friend bool operator>(const asset& a, const asset& b) { return b < a; }
+    friend bool operator>=(const asset& a, const asset& b) { return !(a < b); }
+};
+
+struct extended_asset : public asset {
+    account_name contract = 0;
+
+    extended_symbol get_extended_symbol() const { return extended_symbol(symbol, contract); }
+
+    extended_asset() = default;
+    extended_asset(int64_t v, extended_symbol s)
+        : asset(v, s)
+        , contract(s.contract)
+    {
+    }
+    extended_asset(asset a, account_name c)
+        : asset(a)
+        , contract(c)
+    {
+    }
+
+    extended_asset operator-() const
+    {
+        asset r = this->asset::operator-();
+        return { r, contract };
+    }
+
+    friend extended_asset operator-(const extended_asset& a, const extended_asset& b)
+    {
+        eosio_assert(a.contract == b.contract, "type mismatch");
+        asset r = static_cast<const asset&>(a) - static_cast<const asset&>(b);
+        return { r, a.contract };
+    }
+    friend extended_asset operator+(const extended_asset& a, const extended_asset& b)
+    {
+        eosio_assert(a.contract == b.contract, "type mismatch");
+        asset r = static_cast<const asset&>(a) + static_cast<const asset&>(b);
+        return { r, a.contract };
+    }
+    friend extended_asset& operator-=(extended_asset& a, const extended_asset& b)
+    {
+        a = a - b;
+        return a;
+    }
+    friend extended_asset& operator+=(extended_asset& a, const extended_asset& b)
+    {
+        a = a + b;
+        return a;
+    }
+    friend bool operator<(const extended_asset& a, const extended_asset& b)
+    {
+        eosio_assert(a.contract == b.contract, "type mismatch");
+        return static_cast<const asset&>(a) < static_cast<const asset&>(b);
+    }
+    friend bool operator==(const extended_asset& a, const extended_asset& b)
+    {
+        return std::tie(a.amount, a.symbol.value, a.contract) == std::tie(b.amount, b.symbol.value, b.contract);
+    }
+    friend bool operator!=(const extended_asset& a, const extended_asset& b) { return !(a == b); }
+    friend bool operator<=(const extended_asset& a, const extended_asset& b) { return !(b < a); }
+    friend bool operator>(const extended_asset& a, const extended_asset& b) { return b < a; }
+    friend bool operator>=(const extended_asset& a, const extended_asset& b) { return !(a < b); }
+};
+
+} // namespace eosio
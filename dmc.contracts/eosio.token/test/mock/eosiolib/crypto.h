@@ -0,0 +1,6 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ */
+#pragma once
+#include <eosiolib/eosio.hpp>
@@ -0,0 +1,296 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ *
+ *  主机端测试用的 eosiolib 替身：表存放在内存中，内联 action 只记录不执行
+ */
+#pragma once
+#include <algorithm>
+#include <any>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+typedef unsigned __int128 uint128_t;
+typedef __int128 int128_t;
+typedef uint64_t account_name;
+typedef uint64_t permission_name;
+typedef uint64_t table_name;
+typedef uint64_t scope_name;
+typedef uint64_t action_name;
+
+struct checksum256 {
+    uint8_t hash[32] = {};
+};
+
+struct signature {
+    uint8_t data[66] = {};
+};
+
+struct public_key {
+    uint8_t data[34] = {};
+};
+
+namespace mock {
+
+struct assert_error : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// 每个表登记一次，用于失败回滚与用例之间清空
+struct table_base {
+    virtual ~table_base() {}
+    virtual void save() = 0;
+    virtual void restore() = 0;
+    virtual void clear() = 0;
+};
+
+inline std::vector<table_base*>& tables()
+{
+    static std::vector<table_base*> t;
+    return t;
+}
+
+struct sent_action {
+    account_name account;
+    action_name name;
+    std::any data;
+};
+
+struct chain_state {
+    account_name receiver = 0;
+    uint32_t now = 1600000000;
+    std::set<account_name> auths;
+    std::set<account_name> accounts;
+    std::vector<sent_action> actions;
+    std::vector<char> transaction { 1, 2, 3, 4 };
+};
+
+inline chain_state& chain()
+{
+    static chain_state c;
+    return c;
+}
+
+} // namespace mock
+
+extern "C" {
+
+inline void eosio_assert(uint32_t test, const char* msg)
+{
+    if (!test)
+        throw mock::assert_error(msg);
+}
+
+inline bool has_auth(account_name name)
+{
+    return mock::chain().auths.count(name) != 0;
+}
+
+inline void require_auth(account_name name)
+{
+    eosio_assert(has_auth(name), "missing required authority");
+}
+
+inline bool is_account(account_name name)
+{
+    return mock::chain().accounts.count(name) != 0;
+}
+
+inline void require_recipient(account_name) {}
+
+inline account_name current_receiver()
+{
+    return mock::chain().receiver;
+}
+
+inline uint32_t now()
+{
+    return mock::chain().now;
+}
+
+inline uint64_t current_time()
+{
+    return uint64_t(mock::chain().now) * 1000000;
+}
+
+inline int tapos_block_num()
+{
+    return int(mock::chain().now / 2);
+}
+
+inline int tapos_block_prefix()
+{
+    return int(mock::chain().now * 2654435761u);
+}
+
+// 不是真正的 sha256，只保证同样的输入得到同样的输出
+inline void sha256(const char* data, uint32_t length, checksum256* hash)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < length; i++)
+        h = (h ^ uint8_t(data[i])) * 0x100000001b3ull;
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (h += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        memcpy(hash->hash + i * 8, &z, 8);
+    }
+}
+}
+
+namespace eosio {
+
+constexpr uint64_t char_to_symbol(char c)
+{
+    return (c >= 'a' && c <= 'z') ? (c - 'a') + 6 : (c >= '1' && c <= '5') ? (c - '1') + 1 : 0;
+}
+
+constexpr uint64_t string_to_name(const char* str)
+{
+    uint64_t name = 0;
+    int i = 0;
+    for (; str[i] && i < 12; ++i)
+        name |= (char_to_symbol(str[i]) & 0x1f) << (64 - 5 * (i + 1));
+    if (i == 12)
+        name |= char_to_symbol(str[12]) & 0x0F;
+    return name;
+}
+
+struct name {
+    operator uint64_t() const { return value; }
+    uint64_t value = 0;
+};
+
+typedef std::vector<char> bytes;
+
+inline void pack_to(bytes& out, const std::string& s);
+template <typename T>
+void pack_to(bytes& out, const std::vector<T>& v);
+template <typename... Ts>
+void pack_to(bytes& out, const std::tuple<Ts...>& t);
+
+template <typename T>
+void pack_to(bytes& out, const T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "mock pack only supports plain types");
+    const char* p = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+inline void pack_to(bytes& out, const std::string& s)
+{
+    pack_to(out, uint32_t(s.size()));
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+template <typename T>
+void pack_to(bytes& out, const std::vector<T>& v)
+{
+    pack_to(out, uint32_t(v.size()));
+    for (const auto& e : v)
+        pack_to(out, e);
+}
+
+template <typename... Ts>
+void pack_to(bytes& out, const std::tuple<Ts...>& t)
+{
+    std::apply([&](const auto&... e) { (pack_to(out, e), ...); }, t);
+}
+
+template <typename T>
+bytes pack(const T& value)
+{
+    bytes out;
+    pack_to(out, value);
+    return out;
+}
+
+struct permission_level {
+    permission_level() {}
+    permission_level(account_name a, permission_name p)
+        : actor(a)
+        , permission(p)
+    {
+    }
+    account_name actor = 0;
+    permission_name permission = 0;
+};
+
+struct action {
+    template <typename T>
+    action(std::vector<permission_level> auths, account_name a, action_name n, T&& value)
+        : account(a)
+        , name(n)
+        , authorization(std::move(auths))
+        , data(std::decay_t<T>(std::forward<T>(value)))
+    {
+    }
+
+    template <typename T>
+    action(const permission_level& auth, account_name a, action_name n, T&& value)
+        : action(std::vector<permission_level> { auth }, a, n, std::forward<T>(value))
+    {
+    }
+
+    void send() const
+    {
+        mock::chain().actions.push_back({ account, name, data });
+    }
+
+    account_name account;
+    action_name name;
+    std::vector<permission_level> authorization;
+    std::any data;
+};
+
+template <typename T, uint64_t Name>
+struct inline_dispatcher;
+
+template <typename T, uint64_t Name, typename... Args>
+struct inline_dispatcher<void (T::*)(Args...), Name> {
+    static void call(account_name code, const permission_level& perm, std::tuple<std::decay_t<Args>...> args)
+    {
+        action(perm, code, Name, std::move(args)).send();
+    }
+    static void call(account_name code, std::vector<permission_level> perms, std::tuple<std::decay_t<Args>...> args)
+    {
+        action(std::move(perms), code, Name, std::move(args)).send();
+    }
+};
+
+class contract {
+public:
+    contract(account_name n)
+        : _self(n)
+    {
+    }
+    account_name get_self() const { return _self; }
+
+protected:
+    account_name _self;
+};
+
+template <typename T>
+void print(T) {}
+
+} // namespace eosio
+
+#define N(X) ::eosio::string_to_name(#X)
+#define EOSLIB_SERIALIZE(TYPE, MEMBERS)
+#define EOSLIB_SERIALIZE_DERIVED(TYPE, BASE, MEMBERS)
+#define INLINE_ACTION_SENDER(CONTRACT, NAME) ::eosio::inline_dispatcher<decltype(&CONTRACT::NAME), N(NAME)>::call
+#define SEND_INLINE_ACTION(CONTRACT, NAME, ...) INLINE_ACTION_SENDER(std::remove_reference<decltype(CONTRACT)>::type, NAME)((CONTRACT).get_self(), __VA_ARGS__)
+// 测试直接调用 action 成员函数，不经过 apply 分发
+#define EOSIO_ABI(TYPE, MEMBERS)
+
+#include <eosiolib/multi_index.hpp>
@@ -0,0 +1,461 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ *
+ *  内存中的 multi_index：二级索引在遍历时按 (二级键, 主键) 现算顺序，只求行为一致不求效率
+ */
+#pragma once
+#include <array>
+#include <iterator>
+#include <eosiolib/eosio.hpp>
+
+namespace eosio {
+
+template <size_t Size>
+class fixed_key {
+public:
+    typedef uint128_t word_t;
+    static constexpr size_t num_words() { return (Size + sizeof(word_t) - 1) / sizeof(word_t); }
+
+    fixed_key()
+        : _data()
+    {
+    }
+
+    // 与 eosiolib 相同：按大端顺序把若干字依次填入
+    template <typename FirstWord, typename... Rest>
+    static fixed_key<Size> make_from_word_sequence(FirstWord first_word, Rest... rest)
+    {
+        std::array<FirstWord, sizeof...(Rest) + 1> words { first_word, FirstWord(rest)... };
+        fixed_key<Size> key;
+        uint8_t bytes[Size] = {};
+        size_t pos = 0;
+        for (auto w : words) {
+            for (int i = int(sizeof(FirstWord)) - 1; i >= 0; --i)
+                bytes[pos++] = uint8_t(w >> (8 * i));
+        }
+        for (size_t i = 0; i < num_words(); i++) {
+            word_t v = 0;
+            for (size_t j = 0; j < sizeof(word_t); j++)
+                v = (v << 8) | bytes[i * sizeof(word_t) + j];
+            key._data[i] = v;
+        }
+        return key;
+    }
+
+    const std::array<word_t, num_words()>& get_array() const { return _data; }
+
+    friend bool operator==(const fixed_key& a, const fixed_key& b) { return a._data == b._data; }
+    friend bool operator!=(const fixed_key& a, const fixed_key& b) { return a._data != b._data; }
+    friend bool operator<(const fixed_key& a, const fixed_key& b) { return a._data < b._data; }
+    friend bool operator>(const fixed_key& a, const fixed_key& b) { return b._data < a._data; }
+
+private:
+    std::array<word_t, num_words()> _data;
+};
+
+typedef fixed_key<32> key256;
+
+template <class Class, class Type, Type (Class::*PtrToMemberFunction)() const>
+struct const_mem_fun {
+    typedef typename std::decay<Type>::type result_type;
+    result_type operator()(const Class& x) const { return (x.*PtrToMemberFunction)(); }
+};
+
+template <uint64_t IndexName, typename Extractor>
+struct indexed_by {
+    enum constants { index_name = IndexName };
+    typedef Extractor secondary_extractor_type;
+};
+
+} // namespace eosio
+
+namespace mock {
+
+template <uint64_t TableName, typename T>
+class table_store : public table_base {
+public:
+    struct row {
+        T value;
+        account_name payer;
+    };
+    typedef std::map<uint64_t, row> rows_type;
+
+    static table_store& instance()
+    {
+        static table_store s;
+        return s;
+    }
+
+    rows_type& rows(uint64_t code, uint64_t scope) { return _data[{ code, scope }]; }
+
+    void save() override { _saved = _data; }
+    void restore() override { _data = _saved; }
+    void clear() override
+    {
+        _data.clear();
+        _saved.clear();
+    }
+
+private:
+    table_store() { tables().push_back(this); }
+
+    std::map<std::pair<uint64_t, uint64_t>, rows_type> _data;
+    std::map<std::pair<uint64_t, uint64_t>, rows_type> _saved;
+};
+
+template <uint64_t N, typename... Indices>
+struct find_index;
+
+template <uint64_t N, typename First, typename... Rest>
+struct find_index<N, First, Rest...> {
+    typedef typename std::conditional<uint64_t(First::index_name) == N, First, typename find_index<N, Rest...>::type>::type type;
+};
+
+template <uint64_t N>
+struct find_index<N> {
+    typedef void type;
+};
+
+} // namespace mock
+
+namespace eosio {
+
+template <uint64_t TableName, typename T, typename... Indices>
+class multi_index {
+    typedef mock::table_store<TableName, T> store_type;
+    typedef typename store_type::rows_type rows_type;
+
+public:
+    struct const_iterator {
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef const T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator() {}
+        const_iterator(rows_type* rows, typename rows_type::iterator it)
+            : _rows(rows)
+            , _it(it)
+        {
+        }
+
+        const T& operator*() const
+        {
+            eosio_assert(_it != _rows->end(), "cannot dereference end iterator");
+            return _it->second.value;
+        }
+        const T* operator->() const { return &**this; }
+
+        const_iterator& operator++()
+        {
+            eosio_assert(_it != _rows->end(), "cannot increment end iterator");
+            ++_it;
+            return *this;
+        }
+        const_iterator& operator--()
+        {
+            eosio_assert(_it != _rows->begin(), "cannot decrement iterator at beginning of table");
+            --_it;
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator r = *this;
+            ++*this;
+            return r;
+        }
+        const_iterator operator--(int)
+        {
+            const_iterator r = *this;
+            --*this;
+            return r;
+        }
+
+        bool operator==(const const_iterator& o) const { return _it == o._it; }
+        bool operator!=(const const_iterator& o) const { return _it != o._it; }
+
+        rows_type* _rows = nullptr;
+        typename rows_type::iterator _it;
+    };
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    template <uint64_t IndexName, typename Extractor>
+    class index {
+    public:
+        typedef typename Extractor::result_type secondary_key_type;
+
+        struct const_iterator {
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef const T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const T* pointer;
+            typedef const T& reference;
+
+            const_iterator() {}
+            const_iterator(rows_type* rows, typename rows_type::iterator it)
+                : _rows(rows)
+                , _it(it)
+            {
+            }
+
+            const T& operator*() const
+            {
+                eosio_assert(_it != _rows->end(), "cannot dereference end iterator");
+                return _it->second.value;
+            }
+            const T* operator->() const { return &**this; }
+
+            const_iterator& operator++()
+            {
+                eosio_assert(_it != _rows->end(), "cannot increment end iterator");
+                _it = next(_rows, _it);
+                return *this;
+            }
+            const_iterator& operator--()
+            {
+                _it = prev(_rows, _it);
+                eosio_assert(_it != _rows->end(), "cannot decrement iterator at beginning of index");
+                return *this;
+            }
+            const_iterator operator++(int)
+            {
+                const_iterator r = *this;
+                ++*this;
+                return r;
+            }
+            const_iterator operator--(int)
+            {
+                const_iterator r = *this;
+                --*this;
+                return r;
+            }
+
+            bool operator==(const const_iterator& o) const { return _it == o._it; }
+            bool operator!=(const const_iterator& o) const { return _it != o._it; }
+
+            rows_type* _rows = nullptr;
+            typename rows_type::iterator _it;
+        };
+        typedef const_iterator iterator;
+        typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+        index(multi_index* mi)
+            : _mi(mi)
+        {
+        }
+
+        const_iterator cbegin() const { return lower(nullptr, false); }
+        const_iterator begin() const { return cbegin(); }
+        const_iterator cend() const { return { _mi->_rows, _mi->_rows->end() }; }
+        const_iterator end() const { return cend(); }
+        const_reverse_iterator rbegin() const { return const_reverse_iterator(cend()); }
+        const_reverse_iterator rend() const { return const_reverse_iterator(cbegin()); }
+
+        const_iterator lower_bound(const secondary_key_type& key) const { return lower(&key, false); }
+        const_iterator upper_bound(const secondary_key_type& key) const { return lower(&key, true); }
+
+        const_iterator find(const secondary_key_type& key) const
+        {
+            auto it = lower_bound(key);
+            if (it == cend() || key < secondary(*it) || secondary(*it) < key)
+                return cend();
+            return it;
+        }
+
+        const T& get(const secondary_key_type& key, const char* error_msg = "unable to find secondary key") const
+        {
+            auto it = find(key);
+            eosio_assert(it != cend(), error_msg);
+            return *it;
+        }
+
+        const_iterator iterator_to(const T& obj) const
+        {
+            auto it = _mi->iterator_to(obj);
+            return { _mi->_rows, it._it };
+        }
+
+        template <typename Lambda>
+        void modify(const_iterator itr, account_name payer, Lambda&& updater)
+        {
+            _mi->modify(*itr, payer, std::forward<Lambda>(updater));
+        }
+
+        const_iterator erase(const_iterator itr)
+        {
+            eosio_assert(itr != cend(), "cannot pass end iterator to erase");
+            auto next_itr = itr;
+            ++next_itr;
+            _mi->erase(*itr);
+            return next_itr;
+        }
+
+        static auto secondary(const T& obj) { return Extractor()(obj); }
+
+    private:
+        static bool row_less(typename rows_type::iterator a, typename rows_type::iterator b)
+        {
+            auto ka = secondary(a->second.value);
+            auto kb = secondary(b->second.value);
+            if (ka < kb)
+                return true;
+            if (kb < ka)
+                return false;
+            return a->first < b->first;
+        }
+
+        static typename rows_type::iterator next(rows_type* rows, typename rows_type::iterator cur)
+        {
+            auto best = rows->end();
+            for (auto it = rows->begin(); it != rows->end(); ++it) {
+                if (row_less(cur, it) && (best == rows->end() || row_less(it, best)))
+                    best = it;
+            }
+            return best;
+        }
+
+        static typename rows_type::iterator prev(rows_type* rows, typename rows_type::iterator cur)
+        {
+            auto best = rows->end();
+            for (auto it = rows->begin(); it != rows->end(); ++it) {
+                if ((cur == rows->end() || row_less(it, cur)) && (best == rows->end() || row_less(best, it)))
+                    best = it;
+            }
+            return best;
+        }
+
+        // key 为空时返回第一行；strict 为真时要求二级键严格大于 key
+        const_iterator lower(const secondary_key_type* key, bool strict) const
+        {
+            rows_type* rows = _mi->_rows;
+            auto best = rows->end();
+            for (auto it = rows->begin(); it != rows->end(); ++it) {
+                if (key) {
+                    auto k = secondary(it->second.value);
+                    if (strict ? !(*key < k) : k < *key)
+                        continue;
+                }
+                if (best == rows->end() || row_less(it, best))
+                    best = it;
+            }
+            return { rows, best };
+        }
+
+        multi_index* _mi;
+    };
+
+    multi_index(uint64_t code, uint64_t scope)
+        : _code(code)
+        , _scope(scope)
+        , _rows(&store_type::instance().rows(code, scope))
+    {
+    }
+
+    uint64_t get_code() const { return _code; }
+    uint64_t get_scope() const { return _scope; }
+
+    const_iterator cbegin() const { return { _rows, _rows->begin() }; }
+    const_iterator begin() const { return cbegin(); }
+    const_iterator cend() const { return { _rows, _rows->end() }; }
+    const_iterator end() const { return cend(); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(cend()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(cbegin()); }
+
+    const_iterator lower_bound(uint64_t primary) const { return { _rows, _rows->lower_bound(primary) }; }
+    const_iterator upper_bound(uint64_t primary) const { return { _rows, _rows->upper_bound(primary) }; }
+    const_iterator find(uint64_t primary) const { return { _rows, _rows->find(primary) }; }
+
+    const T& get(uint64_t primary, const char* error_msg = "unable to find key") const
+    {
+        auto it = find(primary);
+        eosio_assert(it != cend(), error_msg);
+        return *it;
+    }
+
+    uint64_t available_primary_key() const
+    {
+        if (_rows->empty())
+            return 0;
+        return _rows->rbegin()->first + 1;
+    }
+
+    const_iterator iterator_to(const T& obj) const
+    {
+        auto it = _rows->find(obj.primary_key());
+        eosio_assert(it != _rows->end() && &it->second.value == &obj, "object passed to iterator_to is not in multi_index");
+        return { _rows, it };
+    }
+
+    template <uint64_t IndexName>
+    auto get_index() const
+    {
+        typedef typename mock::find_index<IndexName, Indices...>::type index_type;
+        static_assert(!std::is_void<index_type>::value, "name provided is not the name of any secondary index within multi_index");
+        return index<IndexName, typename index_type::secondary_extractor_type>(const_cast<multi_index*>(this));
+    }
+
+    template <typename Lambda>
+    const_iterator emplace(account_name payer, Lambda&& constructor)
+    {
+        eosio_assert(_code == current_receiver(), "cannot create objects in table of another contract");
+        T obj;
+        constructor(obj);
+        uint64_t pk = obj.primary_key();
+        eosio_assert(_rows->find(pk) == _rows->end(), "could not insert object, most likely a uniqueness constraint was violated");
+        auto it = _rows->emplace(pk, typename store_type::row { std::move(obj), payer }).first;
+        return { _rows, it };
+    }
+
+    template <typename Lambda>
+    void modify(const_iterator itr, account_name payer, Lambda&& updater)
+    {
+        eosio_assert(itr != cend(), "cannot pass end iterator to modify");
+        modify(*itr, payer, std::forward<Lambda>(updater));
+    }
+
+    template <typename Lambda>
+    void modify(const T& obj, account_name payer, Lambda&& updater)
+    {
+        eosio_assert(_code == current_receiver(), "cannot modify objects in table of another contract");
+        auto it = iterator_to(obj)._it;
+        uint64_t pk = obj.primary_key();
+        updater(it->second.value);
+        eosio_assert(pk == it->second.value.primary_key(), "updater cannot change primary key when modifying an object");
+        if (payer != 0)
+            it->second.payer = payer;
+    }
+
+    const_iterator erase(const_iterator itr)
+    {
+        eosio_assert(itr != cend(), "cannot pass end iterator to erase");
+        auto next_itr = itr;
+        ++next_itr;
+        erase(*itr);
+        return next_itr;
+    }
+
+    void erase(const T& obj)
+    {
+        eosio_assert(_code == current_receiver(), "cannot erase objects in table of another contract");
+        auto it = iterator_to(obj)._it;
+        _rows->erase(it);
+    }
+
+    // 测试用：查询行的 RAM 付费账户
+    account_name payer_of(uint64_t primary) const
+    {
+        auto it = _rows->find(primary);
+        eosio_assert(it != _rows->end(), "unable to find key");
+        return it->second.payer;
+    }
+
+private:
+    uint64_t _code;
+    uint64_t _scope;
+    rows_type* _rows;
+};
+
+} // namespace eosio
@@ -0,0 +1,55 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ */
+#pragma once
+#include <eosiolib/eosio.hpp>
+
+namespace eosio {
+
+class time_point_sec {
+public:
+    time_point_sec()
+        : utc_seconds(0)
+    {
+    }
+    explicit time_point_sec(uint32_t seconds)
+        : utc_seconds(seconds)
+    {
+    }
+
+    static time_point_sec maximum() { return time_point_sec(0xffffffff); }
+    static time_point_sec min() { return time_point_sec(0); }
+
+    uint32_t sec_since_epoch() const { return utc_seconds; }
+
+    time_point_sec& operator=(uint32_t seconds)
+    {
+        utc_seconds = seconds;
+        return *this;
+    }
+    time_point_sec& operator+=(uint32_t m)
+    {
+        utc_seconds += m;
+        return *this;
+    }
+    time_point_sec& operator-=(uint32_t m)
+    {
+        utc_seconds -= m;
+        return *this;
+    }
+
+    friend time_point_sec operator+(const time_point_sec& t, uint32_t offset) { return time_point_sec(t.utc_seconds + offset); }
+    friend time_point_sec operator-(const time_point_sec& t, uint32_t offset) { return time_point_sec(t.utc_seconds - offset); }
+
+    friend bool operator==(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds == b.utc_seconds; }
+    friend bool operator!=(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds != b.utc_seconds; }
+    friend bool operator<(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds < b.utc_seconds; }
+    friend bool operator<=(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds <= b.utc_seconds; }
+    friend bool operator>(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds > b.utc_seconds; }
+    friend bool operator>=(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds >= b.utc_seconds; }
+
+    uint32_t utc_seconds;
+};
+
+} // namespace eosio
@@ -0,0 +1,21 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ */
+#pragma once
+#include <eosiolib/eosio.hpp>
+
+extern "C" {
+
+inline size_t transaction_size()
+{
+    return mock::chain().transaction.size();
+}
+
+inline size_t read_transaction(char* buffer, size_t size)
+{
+    size_t n = std::min(size, transaction_size());
+    memcpy(buffer, mock::chain().transaction.data(), n);
+    return n;
+}
+}
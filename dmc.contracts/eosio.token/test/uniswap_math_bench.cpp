@@ -0,0 +1,85 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ *
+ *  兑换池纯整数运算的主机端基准，对比旧版按 double 计算的兑换公式
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+typedef unsigned __int128 uint128_t;
+
+static void eosio_assert(bool test, const char* msg)
+{
+    if (!test)
+        throw std::runtime_error(msg);
+}
+
+#include <eosio.token/uniswap_math.hpp>
+
+struct sample {
+    int64_t x;
+    int64_t y;
+    int64_t in;
+};
+
+static volatile int64_t sink = 0;
+
+template <typename F>
+static void bench(const char* name, const std::vector<sample>& samples, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    int64_t acc = 0;
+    for (const auto& s : samples)
+        acc += f(s);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    sink = sink + acc;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / samples.size();
+    std::printf("%-28s %8.1f ns/op\n", name, ns);
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::mt19937_64 rng(20260101);
+    auto rand_amount = [&](int64_t lo, int64_t hi) {
+        return std::uniform_int_distribution<int64_t>(lo, hi)(rng);
+    };
+
+    std::vector<sample> normal(count), large(count);
+    for (size_t i = 0; i < count; i++) {
+        normal[i].x = rand_amount(1000000, int64_t(1) << 40);
+        normal[i].y = rand_amount(1000000, int64_t(1) << 40);
+        normal[i].in = rand_amount(1000, normal[i].x / 4);
+        large[i].x = rand_amount(int64_t(1) << 55, int64_t(1) << 60);
+        large[i].y = rand_amount(int64_t(1) << 55, int64_t(1) << 60);
+        large[i].in = rand_amount(1000, large[i].x / 4);
+    }
+
+    // 旧版 uniswapdeal 的浮点公式，仅作对照
+    bench("double amount_out", normal, [](const sample& s) {
+        double fee = double(uniswap_fee_rate) / uniswap_fee_base;
+        double in = s.in * (1 - fee);
+        return int64_t(std::round(in * s.y / (s.x + in)));
+    });
+    bench("amount_out", normal, [](const sample& s) { return uniswap_amount_out(s.in, s.x, s.y); });
+    bench("amount_out (wide)", large, [](const sample& s) { return uniswap_amount_out(s.in, s.x, s.y); });
+    bench("amount_in", normal, [](const sample& s) { return uniswap_amount_in(std::min(s.in, s.y / 2), s.x, s.y); });
+    bench("amount_in (wide)", large, [](const sample& s) { return uniswap_amount_in(std::min(s.in, s.y / 2), s.x, s.y); });
+    bench("zap_amount", normal, [](const sample& s) { return uniswap_zap_amount(s.in, s.x); });
+    bench("zap_amount (wide)", large, [](const sample& s) { return uniswap_zap_amount(s.in, s.x); });
+    bench("batch_price + out", normal, [](const sample& s) {
+        uint128_t num, den;
+        uniswap_batch_price(s.in, s.in / 2 + 1, s.x, s.y, num, den);
+        return uniswap_batch_out(s.in, true, num, den);
+    });
+    bench("lp_mint_shares", normal, [](const sample& s) { return lp_mint_shares(s.in, s.in, s.x, s.y, s.x); });
+    return 0;
+}
@@ -0,0 +1,290 @@
+/**
+ *  @file
+ *  @copyright defined in fibos/LICENSE.txt
+ *
+ *  兑换池纯整数运算的主机端测试，不依赖链上环境，由 test/CMakeLists.txt 注册为 ctest 用例
+ */
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+typedef unsigned __int128 uint128_t;
+
+static void eosio_assert(bool test, const char* msg)
+{
+    if (!test)
+        throw std::runtime_error(msg);
+}
+
+#include <eosio.token/uniswap_math.hpp>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+template <typename F>
+static bool throws(F f)
+{
+    try {
+        f();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+static std::mt19937_64 rng(20260101);
+
+static int64_t rand_amount(int64_t lo, int64_t hi)
+{
+    return std::uniform_int_distribution<int64_t>(lo, hi)(rng);
+}
+
+static uint128_t k_of(int64_t x, int64_t y)
+{
+    return uint128_t(x) * y;
+}
+
+static void test_integer_sqrt()
+{
+    CHECK(integer_sqrt(0) == 0);
+    CHECK(integer_sqrt(1) == 1);
+    CHECK(integer_sqrt(15) == 3);
+    CHECK(integer_sqrt(16) == 4);
+    CHECK(integer_sqrt(~uint128_t(0)) == ~uint64_t(0));
+    for (int i = 0; i < 10000; i++) {
+        uint128_t v = uint128_t(rng()) * rng();
+        uint128_t r = integer_sqrt(v);
+        CHECK(r * r <= v);
+        CHECK((r + 1) * (r + 1) > v || r == ~uint64_t(0));
+    }
+    CHECK(throws([] { mul_uint128(~uint128_t(0), 2); }));
+}
+
+static uint256_parts add_wide(uint256_parts a, uint128_t b)
+{
+    uint128_t low = a.low + b;
+    a.high += low < a.low ? 1 : 0;
+    a.low = low;
+    return a;
+}
+
+static void test_wide_math()
+{
+    for (int i = 0; i < 10000; i++) {
+        uint128_t a = uint128_t(rng()) << (rng() % 64) | rng();
+        uint128_t b = uint128_t(rng()) << (rng() % 64) | rng();
+        uint128_t c = (uint128_t(rng()) << 64 | rng()) | 1;
+
+        uint256_parts product = mul_wide(a, b);
+        if (product.high >= c) {
+            CHECK(throws([&] { mul_div(a, b, c); }));
+            continue;
+        }
+        // q * c <= a * b < (q + 1) * c
+        uint128_t q = mul_div(a, b, c);
+        uint256_parts lower = mul_wide(q, c);
+        uint256_parts upper = add_wide(lower, c);
+        CHECK(!wide_less(product, lower));
+        CHECK(wide_less(product, upper));
+    }
+
+    for (int i = 0; i < 10000; i++) {
+        uint256_parts n;
+        n.high = (uint128_t(rng()) << 64 | rng()) >> (2 + rng() % 126);
+        n.low = uint128_t(rng()) << 64 | rng();
+        uint128_t r = integer_sqrt_wide(n);
+        CHECK(!wide_less(n, mul_wide(r, r)));
+        CHECK(wide_less(n, mul_wide(r + 1, r + 1)));
+    }
+}
+
+// 精度为 8 的大额通证，储备接近 asset::max_amount 时不应因中间值溢出而失败
+static void test_large_reserves()
+{
+    for (int i = 0; i < 10000; i++) {
+        int64_t x = rand_amount(int64_t(1) << 55, int64_t(1) << 60);
+        int64_t y = rand_amount(int64_t(1) << 55, int64_t(1) << 60);
+        int64_t in = rand_amount(1, x / 4);
+
+        int64_t out = uniswap_amount_out(in, x, y);
+        CHECK(out >= 0 && out < y);
+        CHECK(k_of(x + in, y - out) >= k_of(x, y));
+        if (out > 0)
+            CHECK(uniswap_amount_in(out, x, y) <= in);
+
+        int64_t zap_in = rand_amount(x / 1000 + 1000, x / 2);
+        int64_t swap = uniswap_zap_amount(zap_in, x);
+        CHECK(swap > 0 && swap < zap_in);
+
+        uint128_t num, den;
+        int64_t in_y = rand_amount(1, y / 4);
+        uniswap_batch_price(in, in_y, x, y, num, den);
+        int64_t out_y = uniswap_batch_out(in, true, num, den);
+        int64_t out_x = uniswap_batch_out(in_y, false, num, den);
+        CHECK(k_of(x + in - out_x, y + in_y - out_y) >= k_of(x, y));
+    }
+}
+
+static void test_amount_out_in()
+{
+    for (int i = 0; i < 10000; i++) {
+        int64_t x = rand_amount(1000, int64_t(1) << 50);
+        int64_t y = rand_amount(1000, int64_t(1) << 50);
+        int64_t in = rand_amount(1, x);
+
+        int64_t out = uniswap_amount_out(in, x, y);
+        CHECK(out >= 0 && out < y);
+        CHECK(k_of(x + in, y - out) >= k_of(x, y));
+
+        if (out > 0) {
+            // 反向计算的输入不超过原输入，且仍能换出目标数量
+            int64_t need = uniswap_amount_in(out, x, y);
+            CHECK(need <= in);
+            CHECK(uniswap_amount_out(need, x, y) >= out);
+            CHECK(k_of(x + need, y - out) >= k_of(x, y));
+        }
+    }
+    CHECK(throws([] { uniswap_amount_out(0, 100, 100); }));
+    CHECK(throws([] { uniswap_amount_in(100, 100, 100); }));
+}
+
+static void test_zap_amount()
+{
+    for (int i = 0; i < 10000; i++) {
+        int64_t x = rand_amount(1000000, int64_t(1) << 48);
+        int64_t y = rand_amount(1000000, int64_t(1) << 48);
+        int64_t in = rand_amount(x / 1000 + 1000, x);
+
+        int64_t swap = uniswap_zap_amount(in, x);
+        CHECK(swap > 0 && swap < in);
+        int64_t out = uniswap_amount_out(swap, x, y);
+        int64_t new_x = x + swap;
+        int64_t new_y = y - out;
+
+        // 兑换后剩余部分与池中比例相差不超过 1%，满足 uniswapdeposit 的校验
+        uint128_t lhs = uint128_t(in - swap) * new_y;
+        uint128_t rhs = uint128_t(out) * new_x;
+        uint128_t diff = lhs > rhs ? lhs - rhs : rhs - lhs;
+        CHECK(diff <= rhs / 100);
+    }
+}
+
+static void test_batch_price()
+{
+    for (int i = 0; i < 10000; i++) {
+        int64_t x = rand_amount(1000000, int64_t(1) << 48);
+        int64_t y = rand_amount(1000000, int64_t(1) << 48);
+        int orders = int(rand_amount(1, 8));
+        int64_t in_x = 0, in_y = 0;
+        int64_t qty[8];
+        bool from_x[8];
+        for (int j = 0; j < orders; j++) {
+            from_x[j] = rng() & 1;
+            qty[j] = rand_amount(1, (from_x[j] ? x : y) / 4);
+            (from_x[j] ? in_x : in_y) += qty[j];
+        }
+
+        uint128_t num, den;
+        bool pooled = uniswap_batch_price(in_x, in_y, x, y, num, den);
+        if (!pooled && (in_x == 0 || in_y == 0))
+            continue;
+
+        int64_t out_x = 0, out_y = 0;
+        for (int j = 0; j < orders; j++) {
+            int64_t out = uniswap_batch_out(qty[j], from_x[j], num, den);
+            (from_x[j] ? out_y : out_x) += out;
+        }
+        int64_t new_x = x + in_x - out_x;
+        int64_t new_y = y + in_y - out_y;
+        CHECK(new_x > 0 && new_y > 0);
+        CHECK(k_of(new_x, new_y) >= k_of(x, y));
+
+        // 单向批量不优于逐笔拆分前的整笔兑换
+        if (in_y == 0)
+            CHECK(out_y <= uniswap_amount_out(in_x, x, y));
+        if (in_x == 0)
+            CHECK(out_x <= uniswap_amount_out(in_y, y, x));
+    }
+
+    // 双向等值订单完全抵消，不经过兑换池
+    uint128_t num, den;
+    CHECK(!uniswap_batch_price(1000, 2000, 100000, 200000, num, den));
+    CHECK(uniswap_batch_out(1000, true, num, den) == 2000);
+    CHECK(uniswap_batch_out(2000, false, num, den) == 1000);
+}
+
+static void test_lp_mint_burn()
+{
+    CHECK(lp_mint_shares(400, 900, 0, 0, 0) == 600);
+
+    for (int i = 0; i < 10000; i++) {
+        int64_t x = rand_amount(1000000, int64_t(1) << 48);
+        int64_t y = rand_amount(1000000, int64_t(1) << 48);
+        int64_t supply = lp_mint_shares(x, y, 0, 0, 0);
+
+        int64_t add_x = rand_amount(1, x);
+        int64_t add_y = int64_t(uint128_t(add_x) * y / x);
+        int64_t shares = lp_mint_shares(add_x, add_y, x, y, supply);
+        if (shares == 0)
+            continue;
+
+        // 加仓后立即赎回不能取回多于投入的数量
+        int64_t back_x = lp_burn_amount(x + add_x, shares, supply + shares);
+        int64_t back_y = lp_burn_amount(y + add_y, shares, supply + shares);
+        CHECK(back_x <= add_x);
+        CHECK(back_y <= add_y);
+    }
+    CHECK(throws([] { lp_burn_amount(100, 11, 10); }));
+}
+
+// 锁仓把 supply 移入 reserve_supply，赎回时分母必须包含锁仓部分
+static void test_lp_lock_then_withdraw()
+{
+    for (int i = 0; i < 10000; i++) {
+        int64_t x = rand_amount(1000000, int64_t(1) << 48);
+        int64_t y = rand_amount(1000000, int64_t(1) << 48);
+        int64_t total = lp_mint_shares(x, y, 0, 0, 0);
+        int64_t locked = rand_amount(1, total - 1);
+        int64_t free_shares = total - locked;
+
+        int64_t supply = total - locked;
+        int64_t reserve_supply = locked;
+
+        int64_t out_x = lp_burn_amount(x, free_shares, supply + reserve_supply);
+        int64_t out_y = lp_burn_amount(y, free_shares, supply + reserve_supply);
+        CHECK(out_x < x && out_y < y);
+        // 锁仓持有者解锁后仍能按比例取回
+        CHECK(x - out_x >= lp_burn_amount(x, locked, total));
+        CHECK(y - out_y >= lp_burn_amount(y, locked, total));
+
+        // 只按 supply 计算时未锁仓的持有者会取走全部储备
+        CHECK(lp_burn_amount(x, free_shares, supply) == x);
+    }
+}
+
+int main()
+{
+    test_integer_sqrt();
+    test_wide_math();
+    test_large_reserves();
+    test_amount_out_in();
+    test_zap_amount();
+    test_batch_price();
+    test_lp_mint_burn();
+    test_lp_lock_then_withdraw();
+
+    if (failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("all uniswap math tests passed\n");
+    return 0;
+}